@@ -11,24 +11,163 @@
 #include <stdlib.h>         /* malloc, etc */
 #include <stdio.h>          /* printf */
 #include <string.h>         /* strncmp */
+#include <time.h>           /* time, clock */
+#include <errno.h>          /* EINTR */
+#include <unistd.h>         /* read, write */
+#include <sys/mman.h>       /* mmap, madvise */
+#if defined (__GLIBC__)
+#include <malloc.h>         /* malloc_usable_size */
+#endif
+#if defined (__linux__)
+#include <sys/syscall.h>    /* SYS_mbind */
+#endif
+#if defined (_OPENMP)
+#include <omp.h>
+#elif defined (HASHMAP_PTHREADS)
+#include <pthread.h>
+#endif
 #include "hashmap.h"
 
 
 #define MAX_FULLNESS_PERCENT 0.25       /* arbitrary */
+#define CUCKOO_MAX_FULLNESS_PERCENT 0.9 /* two buckets of CUCKOO_SLOTS allow a much fuller table */
+#define CUCKOO_SLOTS 8                  /* node pointers per bucket; one 64 byte cache line */
+#define CUCKOO_SEARCH_SIZE 512          /* buckets examined looking for a displacement path */
+#define STREAM_BUFFER_SIZE 65536       /* bytes buffered by the stream reader and writer */
+#define STREAM_MAGIC "HMAP"
+#define STREAM_FORMAT_VERSION 2        /* 2: NULL values are written with the STREAM_NULL_VALUE length */
+#define STREAM_MAX_LENGTH 0x7fffffffU   /* longest key or value; a longer length is a malformed stream */
+#define STREAM_NULL_VALUE 0xffffffffU   /* length of a NULL value written without an encoder */
+#define STREAM_PRESIZE_MAX 1048576      /* keys the header's count may presize for; past that it is a hint */
+#define HUGE_PAGE_SIZE 2097152         /* bucket arrays smaller than this are not mmap'd */
+#define BATCH_REMOVE_RATIO 64           /* below 1 removal per this many buckets, relayout per key */
+#define RESIZE_STEP 16                  /* old buckets migrated per operation during an incremental resize */
+#define BLOOM_BLOCK_WORDS 8             /* one 64 byte cache line per block */
+#define BLOOM_KEYS_PER_BLOCK 32         /* 16 bits per key */
+#define COMPACT_EMPTY -1                /* compact map index slot values */
+#define COMPACT_REMOVED -2
+
+/* nodes with the expiry of a key set with one; flagged by `expires` in the node */
+typedef struct hashmap_ttl_node {
+    hashmap_node node;
+    uint64_t expiry;
+} hashmap_ttl_node;
+
+/*  every node has room for an expiry so that setting one on an existing key
+    does not move the node, which would invalidate the slot returned by
+    hashmap_get_or_insert; with glibc both sizes take a 48 byte chunk */
+#define NODE_SIZE sizeof(hashmap_ttl_node)
+
+/* the value of a multimap key: a header followed by `capacity` value slots */
+typedef struct hashmap_multi_values {
+    uint64_t count;
+    uint64_t capacity;
+} hashmap_multi_values;
+
+#define MULTI_VALUES(block) ((void**)((hashmap_multi_values*)(block) + 1))
+#define MULTI_INITIAL_CAPACITY 4
+
+/*  a thread's map of an aggregator, padded to whole cache lines; the array is
+    allocated 64 byte aligned so no two share a line */
+struct hashmap_local {
+    HashMap map;
+    char pad[64 - sizeof(HashMap) % 64];
+};
 
 
 /*******************************************************************************
 ***        PRIVATE FUNCTIONS
 *******************************************************************************/
 static uint64_t default_hash(const char *key);
+static inline uint64_t __hash_key(const HashMap *h, const char *key);
+static void  __random_seed(uint64_t seed[2]);
+static int   __reseed(HashMap *h);
+static int   __init_hashmap(HashMap *h, uint64_t num_els, hashmap_hash_function hash_function, int flags, const hashmap_allocator *allocator);
+static inline void* __hm_malloc(const HashMap *h, size_t size);
+static inline void* __hm_calloc(const HashMap *h, size_t num, size_t size);
+static inline void* __hm_realloc(const HashMap *h, void *ptr, size_t size);
+static inline void  __hm_free(const HashMap *h, void *ptr);
+static hashmap_node** __alloc_buckets(const HashMap *h, uint64_t num_els, short *mapped);
+static void  __free_buckets(const HashMap *h, hashmap_node **nodes, uint64_t num_els, short mapped);
+static void  __numa_interleave(void *addr, size_t len);
+static int   __rebuild_nodes(HashMap *h, uint64_t num_els);
+static int   __reserve_nodes(HashMap *h, uint64_t num_keys);
 static inline float __get_fullness(const HashMap *h);
+static inline float __max_fullness(const HashMap *h);
+static inline uint8_t __tag(uint64_t hash);
+static inline void __put_node(HashMap *h, uint64_t i, hashmap_node *node);
+static inline void __move_node(HashMap *h, uint64_t to, uint64_t from);
+static int   __place_node(HashMap *h, hashmap_node *node);
+static inline void __cuckoo_buckets(const HashMap *h, uint64_t hash, uint64_t *b1, uint64_t *b2);
+static void* __cuckoo_get_node(HashMap *h, const char *key, uint64_t hash, uint64_t *i, int *error);
+static int   __cuckoo_make_room(HashMap *h, uint64_t hash, uint64_t *i);
 static inline int __calc_big_o(uint64_t num_nodes, uint64_t i, uint64_t idx);
 static int   __allocate_hashmap(HashMap *h, uint64_t num_els);
 static int   __relayout_nodes(HashMap *h, uint64_t loc, short end_on_null);
 static void* __get_node(HashMap *h, const char *key, uint64_t hash, uint64_t *i, int *error);
-static void  __assign_node(HashMap *h, const char *key, void *value, short mallocd, uint64_t i, uint64_t hash);
-static void* __hashmap_set(HashMap *h, const char *key, void *value, short mallocd);
+static hashmap_node* __lookup_node(HashMap *h, const char *key);
+static uint64_t __find_open_bucket(const HashMap *h);
+static void  __compact_nodes(HashMap *h, uint64_t start);
+static void  __free_node(HashMap *h, hashmap_node *node);
+static void  __remove_node(HashMap *h, uint64_t i);
+static void  __evict_node(HashMap *h);
+static inline void __mark_referenced(hashmap_node *node);
+static char* __acquire_key(HashMap *h, const char *key);
+static void  __release_key(HashMap *h, char *key);
+static void  __visit_range(const HashMap *h, uint64_t begin, uint64_t end, hashmap_visit_function fn, void *ctx);
+static inline int __same_hash(const HashMap *a, const HashMap *b);
+static inline uint64_t __num_buckets(const HashMap *h);
+static inline hashmap_node* __bucket(const HashMap *h, uint64_t i);
+static int   __start_resize(HashMap *h, uint64_t num_els);
+static void  __migrate(HashMap *h, uint64_t budget);
+static void  __settle_key(HashMap *h, const char *key, uint64_t hash);
+static uint64_t __find_old(const HashMap *h, const char *key, uint64_t hash);
+static hashmap_node* __clone_node(HashMap *h, const hashmap_node *node, hashmap_copy_function copy, void *ctx);
+static int   __clone_buckets(HashMap *dst, hashmap_node **to, hashmap_node * const *from, uint64_t num_els, hashmap_copy_function copy, void *ctx);
+static int   __merge_node(HashMap *dst, HashMap *src, hashmap_node *node, int same_hash, hashmap_merge_function conflict, void *ctx);
+static int   __reduce_partition(HashMapAggregator *a, HashMap *part, uint64_t p, uint64_t num_parts, hashmap_merge_function combine, void *ctx);
+static void  __unreduce(HashMapAggregator *a, HashMap *parts, uint64_t num_parts, const uint64_t *starts, hashmap_merge_function combine, void *ctx);
+static int   __assign_node(HashMap *h, const char *key, void *value, short mallocd, uint64_t i, uint64_t hash, short expires);
+static hashmap_node* __get_or_insert_node(HashMap *h, const char *key, uint64_t hash, short mallocd, int *inserted, short expires);
+static void* __hashmap_set(HashMap *h, const char *key, void *value, short mallocd, uint64_t value_size, const uint64_t *expiry);
+static void* __replace_value(HashMap *h, hashmap_node *node, int inserted, void *value, uint64_t value_size, const uint64_t *expiry);
+static inline uint64_t __alloc_overhead(uint64_t size);
+static uint64_t __value_size(const HashMap *h, void *value);
+static uint64_t __buckets_bytes(uint64_t num_els, short mapped);
+static void  __account_node(HashMap *h, const hashmap_node *node, int sign);
+static inline void __account_value(HashMap *h, const hashmap_node *node, int sign);
+static inline uint64_t __bloom_mix(uint64_t hash);
+static inline void __bloom_set(uint64_t *bloom, uint64_t blocks, uint64_t hash);
+static inline void __bloom_add(HashMap *h, uint64_t hash);
+static inline int __bloom_may_contain(const HashMap *h, uint64_t hash);
+static inline uint64_t __bloom_blocks(const HashMap *h);
+static uint64_t* __bloom_alloc(HashMap *h, uint64_t blocks, void **alloc);
+static int   __bloom_build(HashMap *h);
+static void  __bloom_drop_next(HashMap *h);
+static void  __bloom_reset(HashMap *h);
+static void  __bloom_removed(HashMap *h, uint64_t removed);
+static uint64_t __monotonic_ms(void);
+static inline int __is_expired(const HashMap *h, const hashmap_node *node);
+static void  __expire_node(HashMap *h, uint64_t i);
 static void  __calc_stats(const HashMap *h, uint64_t *worst_case, uint64_t *max_big_o, float *avg_big_o, float *avg_used_big_o, unsigned int *hash, unsigned int *idx);
+static int   __stream_write(int fd, unsigned char *buf, size_t *used, const void *data, size_t len);
+static int   __stream_flush(int fd, const unsigned char *buf, size_t len);
+static int   __stream_read(int fd, unsigned char *buf, size_t *pos, size_t *filled, void *data, size_t len);
+static int   __stream_grow(unsigned char **buf, size_t *size, size_t len);
+static int   __stream_read_grow(int fd, unsigned char *buf, size_t *pos, size_t *filled, unsigned char **data, size_t *size, size_t len);
+static void  __put_u32(unsigned char *out, uint32_t v);
+static void  __put_u64(unsigned char *out, uint64_t v);
+static uint32_t __get_u32(const unsigned char *in);
+static uint64_t __get_u64(const unsigned char *in);
+static inline uint64_t __frozen_slot(uint64_t hash, uint32_t displacement, uint64_t n);
+static int   __frozen_place(HashMapFrozen *frozen, hashmap_node **group, uint64_t size, uint64_t group_id, uint8_t *taken, uint64_t *slots);
+static inline int64_t __compact_slot(const HashMapCompact *c, uint64_t i);
+static inline void __compact_set_slot(HashMapCompact *c, uint64_t i, int64_t pos);
+static int64_t __compact_find(const HashMapCompact *c, const char *key, uint64_t hash, uint64_t *slot);
+static int   __compact_resize(HashMapCompact *c, uint64_t num_slots);
+static void __sort_by_bucket(uint64_t *order, uint64_t *tmp, const uint64_t *buckets, uint64_t n, uint64_t num_buckets);
+static void __sort_nodes_by_hash(hashmap_node **nodes, hashmap_node **tmp, uint64_t n);
+static void __sort_nodes_by_key(hashmap_node **nodes, hashmap_node **tmp, uint64_t n, size_t depth);
 static void __merge_sort(uint64_t *arr, uint64_t length);
 static void __m_sort_merge(uint64_t *arr, uint64_t length, uint64_t mid);
 
@@ -37,70 +176,529 @@ static void __m_sort_merge(uint64_t *arr, uint64_t length, uint64_t mid);
 *******************************************************************************/
 
 int hashmap_init_alt(HashMap *h,  uint64_t num_els, hashmap_hash_function hash_function) {
-    h->nodes = (hashmap_node**)calloc(num_els, sizeof(hashmap_node*));
-    if (h->nodes == NULL) {return HASHMAP_FAILURE;}
-    h->number_nodes = num_els;
-    h->used_nodes = 0;
-    h->hash_function = (hash_function == NULL) ? &default_hash : hash_function;
+    return __init_hashmap(h, num_els, hash_function, 0, NULL);
+}
+
+int hashmap_init_cache(HashMap *h, uint64_t capacity, hashmap_hash_function hash_function, hashmap_visit_function evict, void *ctx) {
+    if (capacity == 0) {return HASHMAP_FAILURE;}
+    if (__init_hashmap(h, 1024, hash_function, 0, NULL) == HASHMAP_FAILURE) {return HASHMAP_FAILURE;}
+    // size it up front so that reaching the capacity never resizes
+    if (__reserve_nodes(h, capacity + 1) == HASHMAP_FAILURE) {
+        hashmap_destroy(h);
+        return HASHMAP_FAILURE;
+    }
+    h->capacity = capacity;
+    h->evict = evict;
+    h->evict_ctx = ctx;
+    return HASHMAP_SUCCESS;
+}
+
+int hashmap_init_incremental(HashMap *h, uint64_t num_els, hashmap_hash_function hash_function) {
+    if (__init_hashmap(h, num_els, hash_function, 0, NULL) == HASHMAP_FAILURE) {return HASHMAP_FAILURE;}
+    h->incremental = 1;
+    return HASHMAP_SUCCESS;
+}
+
+uint64_t hashmap_resize_step(HashMap *h, uint64_t budget) {
+    __migrate(h, budget);
+    return h->old_number_nodes - h->migrated;
+}
+
+int hashmap_enable_bloom(HashMap *h) {
+    return (h->bloom != NULL) ? HASHMAP_SUCCESS : __bloom_build(h);
+}
+
+void hashmap_disable_bloom(HashMap *h) {
+    __bloom_drop_next(h);
+    __hm_free(h, h->bloom_alloc);
+    h->bloom = NULL;
+    h->bloom_alloc = NULL;
+    h->bloom_blocks = 0;
+    h->bloom_removed = 0;
+}
+
+int hashmap_init_cuckoo(HashMap *h, uint64_t num_els, hashmap_hash_function hash_function) {
+    // a whole number of buckets, and at least two of them
+    num_els = (num_els < 2 * CUCKOO_SLOTS) ? 2 * CUCKOO_SLOTS : (num_els + CUCKOO_SLOTS - 1) / CUCKOO_SLOTS * CUCKOO_SLOTS;
+    if (__init_hashmap(h, num_els, hash_function, 0, NULL) == HASHMAP_FAILURE) {return HASHMAP_FAILURE;}
+    h->engine = HASHMAP_CUCKOO;
+    return HASHMAP_SUCCESS;
+}
+
+int hashmap_init_with_flags(HashMap *h, uint64_t num_els, hashmap_hash_function hash_function, int flags) {
+    return __init_hashmap(h, num_els, hash_function, flags, NULL);
+}
+
+int hashmap_init_with_allocator(HashMap *h, uint64_t num_els, hashmap_hash_function hash_function, const hashmap_allocator *allocator) {
+    return __init_hashmap(h, num_els, hash_function, 0, allocator);
+}
+
+int hashmap_init_interned(HashMap *h, uint64_t num_els, hashmap_hash_function hash_function, HashMap *pool) {
+    if (hashmap_init_alt(h, num_els, hash_function) == HASHMAP_FAILURE) {return HASHMAP_FAILURE;}
+    h->intern_pool = pool;
+    return HASHMAP_SUCCESS;
+}
+
+const char* hashmap_intern(HashMap *pool, const char *key) {
+    int inserted;
+    hashmap_node *node = __get_or_insert_node(pool, key, __hash_key(pool, key), -1, &inserted, 0);
+    if (node == NULL) {
+        return NULL;
+    }
+    // the reference count is kept in the value itself
+    node->value = (void*)((uintptr_t)node->value + 1);
+    return node->key;
+}
+
+void hashmap_intern_release(HashMap *pool, const char *key) {
+    uint64_t i, hash = __hash_key(pool, key);
+    int e;
+    __settle_key(pool, key, hash);
+    __get_node(pool, key, hash, &i, &e);
+    if (e == 0 && pool->nodes[i] != NULL) {
+        pool->nodes[i]->value = (void*)((uintptr_t)pool->nodes[i]->value - 1);
+        if (pool->nodes[i]->value == NULL) {
+            __remove_node(pool, i);
+        }
+    }
+}
+
+int hashmap_init_seeded(HashMap *h, uint64_t num_els, hashmap_keyed_hash_function hash_function, const uint64_t seed[2]) {
+    if (hashmap_init_alt(h, num_els, NULL) == HASHMAP_FAILURE) {return HASHMAP_FAILURE;}
+    h->keyed_hash_function = (hash_function == NULL) ? &hashmap_siphash : hash_function;
+    if (seed == NULL) {
+        __random_seed(h->seed);
+    } else {
+        h->seed[0] = seed[0];
+        h->seed[1] = seed[1];
+    }
     return HASHMAP_SUCCESS;
 }
 
 void hashmap_destroy(HashMap *h) {
-    hashmap_clear(h);
-    free(h->nodes);
+    hashmap_clear(h);  // also finishes any incremental resize
+    __free_buckets(h, h->nodes, h->number_nodes, h->buckets_mapped);
+    __hm_free(h, h->tags);
+    hashmap_disable_bloom(h);
     h->used_nodes = 0;
     h->hash_function = NULL;
+    h->keyed_hash_function = NULL;
 }
 
 void hashmap_clear(HashMap *h) {
     uint64_t i;
+    __migrate(h, UINT64_MAX);
     for (i = 0; i < h->number_nodes; ++i) {
         if (h->nodes[i] != NULL) {
-            free(h->nodes[i]->key);
-            if (h->nodes[i]->mallocd == 0) {
-                free(h->nodes[i]->value);
-            }
-            free(h->nodes[i]);
+            __free_node(h, h->nodes[i]);
             h->nodes[i] = NULL;
         }
     }
     h->used_nodes = 0;
+    __bloom_reset(h);
+    // a map cleared after its nodes were moved out uncounted, as the aggregator does, starts over
+    h->node_bytes = h->key_bytes = h->value_bytes = h->alloc_overhead = 0;
 }
 
 void* hashmap_set(HashMap *h, const char *key, void *value) {
-    return __hashmap_set(h, key, value, -1);
+    return __hashmap_set(h, key, value, -1, 0, NULL);
 }
 
 void* hashmap_set_alt(HashMap *h, const char *key, void * value) {
-    return __hashmap_set(h, key, value, 0);
+    return __hashmap_set(h, key, value, 0, __value_size(h, value), NULL);
+}
+
+void* hashmap_set_ttl(HashMap *h, const char *key, void *value, uint64_t expiry) {
+    return __hashmap_set(h, key, value, -1, 0, &expiry);
+}
+
+void hashmap_set_expiry(HashMap *h, hashmap_clock_function clock, hashmap_visit_function expired, void *ctx) {
+    h->clock = clock;
+    h->evict = expired;
+    h->evict_ctx = ctx;
+}
+
+uint64_t hashmap_set_many(HashMap *h, const char * const *keys, void * const *values, uint64_t n, void **replaced) {
+    uint64_t k, set = 0;
+    uint64_t *hashes = NULL, *buckets = NULL, *order = NULL, *tmp = NULL;
+    __migrate(h, UINT64_MAX);
+    // a cache holds no more than its capacity so there is no room to reserve; its keys go in one at a time
+    if (h->capacity == 0 && __reserve_nodes(h, h->used_nodes + n) == HASHMAP_SUCCESS) {
+        hashes = (uint64_t*)malloc(n * sizeof(uint64_t));
+        buckets = (uint64_t*)malloc(n * sizeof(uint64_t));
+        order = (uint64_t*)malloc(n * sizeof(uint64_t));
+        tmp = (uint64_t*)malloc(n * sizeof(uint64_t));
+    }
+    const int batched = (hashes != NULL && buckets != NULL && order != NULL && tmp != NULL);
+    if (batched) {
+        int64_t q;
+        #if defined (_OPENMP)
+        #pragma omp parallel for if (n >= 4096) schedule(static)
+        #endif
+        for (q = 0; q < (int64_t)n; ++q) {
+            uint64_t b2;
+            hashes[q] = __hash_key(h, keys[q]);
+            if (h->engine == HASHMAP_CUCKOO) {
+                __cuckoo_buckets(h, hashes[q], &buckets[q], &b2);
+            } else {
+                buckets[q] = hashes[q] % h->number_nodes;
+            }
+            order[q] = q;
+        }
+        // insert in bucket order so the probes walk the table front to back; the sort
+        // is stable so a key repeated in the batch still ends up with its last value
+        __sort_by_bucket(order, tmp, buckets, n, h->number_nodes);
+    }
+
+    const uint64_t seed[2] = {h->seed[0], h->seed[1]};
+    for (k = 0; k < n; ++k) {
+        uint64_t j = batched ? order[k] : k;
+        int inserted;
+        // a keyed map that re-seeds mid batch invalidates the rest of the hashes
+        int stale = !batched || h->seed[0] != seed[0] || h->seed[1] != seed[1];
+        hashmap_node *node = __get_or_insert_node(h, keys[j], stale ? __hash_key(h, keys[j]) : hashes[j], -1, &inserted, 0);
+        void *v = NULL;
+        if (node != NULL) {
+            v = __replace_value(h, node, inserted, values[j], 0, NULL);
+            v = (inserted || v == values[j]) ? NULL : v;
+            ++set;
+        }
+        if (replaced != NULL) {
+            replaced[j] = v;
+        }
+    }
+    free(hashes);
+    free(buckets);
+    free(order);
+    free(tmp);
+    return set;
+}
+
+uint64_t hashmap_expire_step(HashMap *h, uint64_t budget) {
+    __migrate(h, UINT64_MAX);
+    uint64_t removed = 0, i = (h->expire_cursor < h->number_nodes) ? h->expire_cursor : 0;
+    uint64_t now = (h->clock == NULL) ? __monotonic_ms() : h->clock();
+    for (; budget > 0; --budget) {
+        hashmap_node *node = h->nodes[i];
+        if (node != NULL && node->expires != 0 && ((hashmap_ttl_node*)node)->expiry <= now) {
+            __expire_node(h, i);
+            ++removed;
+            continue;  // the re-layout may have moved another node into this bucket
+        }
+        i = (i + 1 == h->number_nodes) ? 0 : i + 1;
+    }
+    h->expire_cursor = i;
+    return removed;
 }
 
 void* hashmap_get(HashMap *h, const char *key) {
-    uint64_t i, hash = h->hash_function(key);
-    int e;
-    i = hash % h->number_nodes;
-    return __get_node(h, key, hash, &i, &e);
+    hashmap_node *node = __lookup_node(h, key);
+    return (node == NULL) ? NULL : node->value;
 }
 
 void* hashmap_remove(HashMap *h, const char *key) {
-    uint64_t i, hash = h->hash_function(key);
+    uint64_t i, hash = __hash_key(h, key);
+    if (!__bloom_may_contain(h, hash)) {return NULL;}
+    __settle_key(h, key, hash);
     i = hash % h->number_nodes;
     int e;
     void* ret = __get_node(h, key, hash, &i, &e);
-    if (ret != NULL) {
-        free(h->nodes[i]->key);
+    if (e == 0 && h->nodes[i] != NULL) {
+        if (__is_expired(h, h->nodes[i])) {  // it was already gone
+            __expire_node(h, i);
+            return NULL;
+        }
         if (h->nodes[i]->mallocd == 0) {
-            free(h->nodes[i]->value);
             ret = NULL;
         }
-        free(h->nodes[i]);
-        h->nodes[i] = NULL;
-        h->used_nodes--;
-        __relayout_nodes(h, i, 0);
+        __remove_node(h, i);
     }
     return ret;
 }
 
+uint64_t hashmap_remove_many(HashMap *h, const char * const *keys, uint64_t n, void **values) {
+    __migrate(h, UINT64_MAX);
+    uint64_t k, removed = 0;
+    if (n * BATCH_REMOVE_RATIO < h->number_nodes) {
+        // too few keys to make a pass over the whole table worth it
+        for (k = 0; k < n; ++k) {
+            uint64_t used = h->used_nodes;
+            void *v = hashmap_remove(h, keys[k]);
+            if (values != NULL) {
+                values[k] = v;
+            }
+            removed += used - h->used_nodes;
+        }
+        return removed;
+    }
+
+    // find all the victims while the layout is still intact then compact once
+    uint64_t start = __find_open_bucket(h);
+    unsigned char *marks = (unsigned char*)calloc(h->number_nodes, sizeof(unsigned char));
+    if (marks == NULL) {return 0;}
+    for (k = 0; k < n; ++k) {
+        uint64_t i, hash = __hash_key(h, keys[k]);
+        int e;
+        void *v = __get_node(h, keys[k], hash, &i, &e);
+        if (e != 0 || h->nodes[i] == NULL || marks[i] != 0) {
+            v = NULL;  // not present or already removed earlier in the batch
+        } else {
+            marks[i] = 1;
+            if (h->nodes[i]->mallocd == 0) {
+                v = NULL;
+            }
+        }
+        if (values != NULL) {
+            values[k] = v;
+        }
+    }
+    for (k = 0; k < h->number_nodes; ++k) {
+        if (marks[k] != 0) {
+            __free_node(h, h->nodes[k]);
+            h->nodes[k] = NULL;
+            ++removed;
+        }
+    }
+    free(marks);
+    h->used_nodes -= removed;
+    if (removed != 0) {
+        __compact_nodes(h, start);
+    }
+    __bloom_removed(h, removed);
+    return removed;
+}
+
+uint64_t hashmap_remove_if(HashMap *h, hashmap_predicate_function predicate, void *ctx) {
+    __migrate(h, UINT64_MAX);
+    uint64_t i, removed = 0, start = __find_open_bucket(h);
+    for (i = 0; i < h->number_nodes; ++i) {
+        if (h->nodes[i] != NULL && predicate(h->nodes[i]->key, h->nodes[i]->value, ctx) != 0) {
+            __free_node(h, h->nodes[i]);
+            h->nodes[i] = NULL;
+            ++removed;
+        }
+    }
+    h->used_nodes -= removed;
+    if (removed != 0) {
+        __compact_nodes(h, start);
+    }
+    __bloom_removed(h, removed);
+    return removed;
+}
+
+int hashmap_merge(HashMap *dst, HashMap *src, hashmap_merge_function conflict, void *ctx) {
+    if (dst == src) {return HASHMAP_SUCCESS;}
+    // moved nodes are released by dst so they must come from the same allocator
+    if (dst->allocator != src->allocator) {return HASHMAP_FAILURE;}
+    __migrate(dst, UINT64_MAX);
+    __migrate(src, UINT64_MAX);
+    // make room for everything up front so the merge never resizes
+    if (__reserve_nodes(dst, dst->used_nodes + src->used_nodes) == HASHMAP_FAILURE) {return HASHMAP_FAILURE;}
+    int same_hash = __same_hash(dst, src);
+    uint64_t start = __find_open_bucket(src);
+    for (uint64_t k = 0; k < src->number_nodes; ++k) {
+        hashmap_node *node = src->nodes[k];
+        if (node == NULL) {
+            continue;
+        }
+        src->nodes[k] = NULL;
+        --src->used_nodes;
+        __account_node(src, node, -1);
+        if (__merge_node(dst, src, node, same_hash, conflict, ctx) == HASHMAP_FAILURE) {
+            // out of memory; this node and what is left stay in src, closing the gaps the moved ones left
+            src->nodes[k] = node;
+            ++src->used_nodes;
+            __account_node(src, node, 1);
+            __compact_nodes(src, start);
+            return HASHMAP_FAILURE;
+        }
+    }
+    while (dst->capacity != 0 && dst->used_nodes > dst->capacity) {
+        __evict_node(dst);
+    }
+    return HASHMAP_SUCCESS;
+}
+
+int hashmap_clone(HashMap *dst, const HashMap *src, hashmap_copy_function copy, void *ctx) {
+    *dst = *src;  // the settings, callbacks, seed and resize progress
+    dst->used_nodes = 0;
+    dst->node_bytes = dst->key_bytes = dst->value_bytes = dst->alloc_overhead = 0;
+    dst->old_nodes = NULL;
+    dst->old_tags = NULL;
+    dst->bloom_alloc = dst->bloom_next_alloc = NULL;
+    dst->bloom = dst->bloom_next = NULL;
+    dst->bloom_blocks = dst->bloom_next_blocks = 0;
+    dst->nodes = __alloc_buckets(dst, src->number_nodes, &dst->buckets_mapped);
+    dst->tags = (uint8_t*)__hm_malloc(dst, src->number_nodes * sizeof(uint8_t));
+    if (src->old_nodes != NULL) {
+        dst->old_nodes = __alloc_buckets(dst, src->old_number_nodes, &dst->old_buckets_mapped);
+        dst->old_tags = (uint8_t*)__hm_malloc(dst, src->old_number_nodes * sizeof(uint8_t));
+    }
+    if (src->bloom != NULL) {
+        dst->bloom = __bloom_alloc(dst, src->bloom_blocks, &dst->bloom_alloc);
+        dst->bloom_blocks = src->bloom_blocks;
+    }
+    if (src->bloom_next != NULL) {
+        dst->bloom_next = __bloom_alloc(dst, src->bloom_next_blocks, &dst->bloom_next_alloc);
+        dst->bloom_next_blocks = src->bloom_next_blocks;
+    }
+    if (dst->nodes == NULL || dst->tags == NULL || (src->old_nodes != NULL && (dst->old_nodes == NULL || dst->old_tags == NULL)) ||
+        (src->bloom != NULL && dst->bloom == NULL) || (src->bloom_next != NULL && dst->bloom_next == NULL)) {
+        if (dst->nodes != NULL) {
+            __free_buckets(dst, dst->nodes, dst->number_nodes, dst->buckets_mapped);
+        }
+        if (dst->old_nodes != NULL) {
+            __free_buckets(dst, dst->old_nodes, dst->old_number_nodes, dst->old_buckets_mapped);
+        }
+        __hm_free(dst, dst->tags);
+        __hm_free(dst, dst->old_tags);
+        __hm_free(dst, dst->bloom_alloc);
+        __hm_free(dst, dst->bloom_next_alloc);
+        return HASHMAP_FAILURE;
+    }
+    memcpy(dst->tags, src->tags, src->number_nodes * sizeof(uint8_t));
+    if (src->old_nodes != NULL) {
+        memcpy(dst->old_tags, src->old_tags, src->old_number_nodes * sizeof(uint8_t));
+    }
+    if (src->bloom != NULL) {
+        memcpy(dst->bloom, src->bloom, src->bloom_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t));
+    }
+    if (src->bloom_next != NULL) {
+        memcpy(dst->bloom_next, src->bloom_next, src->bloom_next_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t));
+    }
+    if (__clone_buckets(dst, dst->nodes, src->nodes, src->number_nodes, copy, ctx) == HASHMAP_FAILURE ||
+        (src->old_nodes != NULL && __clone_buckets(dst, dst->old_nodes, src->old_nodes, src->old_number_nodes, copy, ctx) == HASHMAP_FAILURE)) {
+        hashmap_destroy(dst);  // frees the nodes copied so far
+        return HASHMAP_FAILURE;
+    }
+    return HASHMAP_SUCCESS;
+}
+
+void** hashmap_get_or_insert(HashMap *h, const char *key, int *inserted) {
+    int ins;
+    hashmap_node *node = __get_or_insert_node(h, key, __hash_key(h, key), -1, &ins, 0);
+    if (inserted != NULL) {
+        *inserted = ins;
+    }
+    return (node == NULL) ? NULL : &node->value;
+}
+
+int* hashmap_increment(HashMap *h, const char *key, const int delta) {
+    int inserted;
+    uint64_t hash = __hash_key(h, key);
+    hashmap_node *node = __get_or_insert_node(h, key, hash, 0, &inserted, 0);
+    if (node == NULL) {
+        return NULL;
+    }
+    if (inserted) {
+        int *ptr = (int*)__hm_malloc(h, sizeof(int));
+        if (ptr == NULL) {  // take the key back out rather than leave it without its int
+            uint64_t i;
+            int e;
+            __get_node(h, key, hash, &i, &e);
+            __remove_node(h, i);
+            return NULL;
+        }
+        *ptr = delta;
+        node->value = ptr;
+        node->value_size = sizeof(int);
+        __account_value(h, node, 1);
+    } else {
+        *(int*)node->value += delta;
+    }
+    return (int*)node->value;
+}
+
+int hashmap_multi_add(HashMap *h, const char *key, void *value) {
+    int inserted;
+    hashmap_node *node = __get_or_insert_node(h, key, __hash_key(h, key), 0, &inserted, 0);
+    if (node == NULL) {return HASHMAP_FAILURE;}
+    if (inserted) {
+        node->multi = 1;
+    } else if (node->multi == 0) {
+        return HASHMAP_FAILURE;  // not a multimap key
+    }
+    hashmap_multi_values *block = (hashmap_multi_values*)node->value;
+    if (block == NULL) {  // a new key, or allocating the block failed before
+        block = (hashmap_multi_values*)__hm_malloc(h, sizeof(hashmap_multi_values) + MULTI_INITIAL_CAPACITY * sizeof(void*));
+        if (block == NULL) {return HASHMAP_FAILURE;}
+        block->count = 0;
+        block->capacity = MULTI_INITIAL_CAPACITY;
+        node->value = block;
+        node->value_size = sizeof(hashmap_multi_values) + MULTI_INITIAL_CAPACITY * sizeof(void*);
+        __account_value(h, node, 1);
+    } else if (block->count == block->capacity) {
+        uint64_t capacity = block->capacity * 2;
+        block = (hashmap_multi_values*)__hm_realloc(h, block, sizeof(hashmap_multi_values) + capacity * sizeof(void*));
+        if (block == NULL) {return HASHMAP_FAILURE;}
+        __account_value(h, node, -1);
+        block->capacity = capacity;
+        node->value = block;
+        node->value_size = sizeof(hashmap_multi_values) + capacity * sizeof(void*);
+        __account_value(h, node, 1);
+    }
+    MULTI_VALUES(block)[block->count++] = value;
+    return HASHMAP_SUCCESS;
+}
+
+void** hashmap_multi_get(HashMap *h, const char *key, uint64_t *count) {
+    hashmap_node *node = __lookup_node(h, key);
+    hashmap_multi_values *block = (node == NULL || node->multi == 0) ? NULL : (hashmap_multi_values*)node->value;
+    *count = (block == NULL) ? 0 : block->count;
+    return (block == NULL) ? NULL : MULTI_VALUES(block);
+}
+
+int hashmap_multi_remove_value(HashMap *h, const char *key, const void *value) {
+    uint64_t i, j, hash = __hash_key(h, key);
+    int e;
+    if (!__bloom_may_contain(h, hash)) {return HASHMAP_FAILURE;}
+    __settle_key(h, key, hash);
+    hashmap_multi_values *block = (hashmap_multi_values*)__get_node(h, key, hash, &i, &e);
+    if (block == NULL || e != 0 || h->nodes[i] == NULL || h->nodes[i]->multi == 0) {return HASHMAP_FAILURE;}
+    void **values = MULTI_VALUES(block);
+    for (j = 0; j < block->count && values[j] != value; ++j) { }
+    if (j == block->count) {return HASHMAP_FAILURE;}
+    if (block->count == 1) {  // the last value takes the key with it
+        __remove_node(h, i);
+        return HASHMAP_SUCCESS;
+    }
+    memmove(values + j, values + j + 1, (block->count - j - 1) * sizeof(void*));
+    --block->count;
+    return HASHMAP_SUCCESS;
+}
+
+uint64_t hashmap_memory_usage(const HashMap *h, hashmap_memory *breakdown) {
+    hashmap_memory m;
+    m.buckets = __buckets_bytes(h->number_nodes, h->buckets_mapped) + h->number_nodes;
+    m.overhead = h->alloc_overhead + __alloc_overhead(h->number_nodes);
+    if (h->buckets_mapped == 0) {
+        m.overhead += __alloc_overhead(h->number_nodes * sizeof(hashmap_node*));
+    }
+    if (h->bloom != NULL) {
+        m.buckets += h->bloom_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t);
+        m.overhead += __alloc_overhead(h->bloom_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t) + 63) + 63;
+    }
+    if (h->bloom_next != NULL) {
+        m.buckets += h->bloom_next_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t);
+        m.overhead += __alloc_overhead(h->bloom_next_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t) + 63) + 63;
+    }
+    if (h->old_nodes != NULL) {
+        m.buckets += __buckets_bytes(h->old_number_nodes, h->old_buckets_mapped) + h->old_number_nodes;
+        m.overhead += __alloc_overhead(h->old_number_nodes);
+        if (h->old_buckets_mapped == 0) {
+            m.overhead += __alloc_overhead(h->old_number_nodes * sizeof(hashmap_node*));
+        }
+    }
+    m.nodes = h->node_bytes;
+    m.keys = h->key_bytes;
+    m.values = h->value_bytes;
+    m.total = m.buckets + m.nodes + m.keys + m.values + m.overhead;
+    if (breakdown != NULL) {
+        *breakdown = m;
+    }
+    return m.total;
+}
+
 float hashmap_get_fullness(const HashMap *h) {
     return __get_fullness(h) * 100.0;
 }
@@ -114,7 +712,7 @@ void hashmap_stats(const HashMap *h) {
        plus the size of the array of pointers
        plus the size of the number of allocated nodes
        NOTE: this does NOT include the key and value sizes */
-    uint64_t size = sizeof(HashMap) + (sizeof(hashmap_node*) * h->number_nodes) + (sizeof(hashmap_node) * h->used_nodes);
+    uint64_t size = sizeof(HashMap) + ((sizeof(hashmap_node*) + sizeof(uint8_t)) * __num_buckets(h)) + (NODE_SIZE * h->used_nodes);
     printf("HashMap:\n\
     Number Nodes: %" PRIu64 "\n\
     Used Nodes: %" PRIu64 "\n\
@@ -132,168 +730,1944 @@ void hashmap_stats(const HashMap *h) {
 char** hashmap_keys(const HashMap *h) {
     char** keys = (char**)calloc(h->used_nodes, sizeof(char*));
     uint64_t i, j = 0;
-    for (i = 0; i < h->number_nodes; ++i) {
-        if (h->nodes[i] != NULL) {
-            int len = strlen(h->nodes[i]->key);
+    for (i = 0; i < __num_buckets(h); ++i) {
+        hashmap_node *node = __bucket(h, i);
+        if (node != NULL) {
+            int len = strlen(node->key);
             keys[j] = (char*)calloc(len + 1, sizeof(char));
-            memcpy(keys[j], h->nodes[i]->key, len);
+            memcpy(keys[j], node->key, len);
             ++j;
         }
     }
     return keys;
 }
 
-/*******************************************************************************
-***        UTILITY INSERTS
-*******************************************************************************/
-
-int* hashmap_set_int(HashMap *h, const char *key, const int value) {
-    int *ptr = (int*)malloc(sizeof(int));
-    *ptr = value;
-    return (int*)__hashmap_set(h, key, (void*)ptr, 0);
-}
-
-long* hashmap_set_long(HashMap *h, const char *key, const long value) {
-    long *ptr = (long*)malloc(sizeof(long));
-    *ptr = value;
-    return (long*)__hashmap_set(h, key, (void*)ptr, 0);
+void hashmap_for_each(const HashMap *h, hashmap_visit_function fn, void *ctx) {
+    __visit_range(h, 0, __num_buckets(h), fn, ctx);
 }
 
-char* hashmap_set_string(HashMap *h, const char *key, const char *value) {
-    int len = strlen(value);
-    char *ptr = (char*)calloc(len + 1, sizeof(char));
-    memcpy(ptr, value, len);
-    return (char*)__hashmap_set(h, key, (void*)ptr, 0);
-}
+#if !defined (_OPENMP) && defined (HASHMAP_PTHREADS)
+typedef struct __visit_args {
+    const HashMap *h;
+    uint64_t begin, end;
+    hashmap_visit_function fn;
+    void *ctx;
+} __visit_args;
 
-float* hashmap_set_float(HashMap *h, const char *key, const float value) {
-    float *ptr = (float*)malloc(sizeof(float));
-    *ptr = value;
-    return (float*)__hashmap_set(h, key, (void*)ptr, 0);
+static void* __visit_thread(void *arg) {
+    __visit_args *a = (__visit_args*)arg;
+    __visit_range(a->h, a->begin, a->end, a->fn, a->ctx);
+    return NULL;
 }
+#endif
 
-double* hashmap_set_double(HashMap *h, const char *key, const double value) {
-    double *ptr = (double*)malloc(sizeof(double));
-    *ptr = value;
-    return (double*)__hashmap_set(h, key, ptr, 0);
+int hashmap_parallel_for_each(const HashMap *h, hashmap_visit_function fn, void *ctx, int nthreads) {
+    /*  Each thread gets its own contiguous range of buckets; only reads are
+        done so nodes are visited exactly once whatever the cluster boundaries */
+    const uint64_t num_buckets = __num_buckets(h);
+    #if defined (_OPENMP)
+    if (nthreads <= 0) {
+        nthreads = omp_get_max_threads();
+    }
+    const uint64_t step = num_buckets / nthreads + 1;
+    int t;
+    #pragma omp parallel for num_threads(nthreads) schedule(static, 1)
+    for (t = 0; t < nthreads; ++t) {
+        uint64_t begin = t * step, end = begin + step;
+        __visit_range(h, begin, (end > num_buckets) ? num_buckets : end, fn, ctx);
+    }
+    return HASHMAP_SUCCESS;
+    #elif defined (HASHMAP_PTHREADS)
+    if (nthreads <= 1) {
+        hashmap_for_each(h, fn, ctx);
+        return HASHMAP_SUCCESS;
+    }
+    const uint64_t step = num_buckets / nthreads + 1;
+    pthread_t *threads = (pthread_t*)malloc(nthreads * sizeof(pthread_t));
+    __visit_args *args = (__visit_args*)malloc(nthreads * sizeof(__visit_args));
+    int t, started = 0, res = HASHMAP_SUCCESS;
+    if (threads == NULL || args == NULL) {
+        res = HASHMAP_FAILURE;
+    }
+    for (t = 0; t < nthreads && res == HASHMAP_SUCCESS; ++t) {
+        uint64_t begin = t * step, end = begin + step;
+        args[t].h = h;
+        args[t].begin = begin;
+        args[t].end = (end > num_buckets) ? num_buckets : end;
+        args[t].fn = fn;
+        args[t].ctx = ctx;
+        if (pthread_create(&threads[t], NULL, &__visit_thread, &args[t]) != 0) {
+            res = HASHMAP_FAILURE;
+        } else {
+            ++started;
+        }
+    }
+    for (t = 0; t < started; ++t) {
+        pthread_join(threads[t], NULL);
+    }
+    free(threads);
+    free(args);
+    return res;
+    #else
+    (void)nthreads;
+    (void)num_buckets;
+    hashmap_for_each(h, fn, ctx);
+    return HASHMAP_SUCCESS;
+    #endif
 }
 
 /*******************************************************************************
-***        PRIVATE FUNCTIONS
+***        AGGREGATION
 *******************************************************************************/
-static uint64_t default_hash(const char *key) { // FNV-1a hash (http://www.isthe.com/chongo/tech/comp/fnv/)
-    int i, len = strlen(key);
-    uint64_t h = 14695981039346656037ULL; // FNV_OFFSET 64 bit
-    for (i = 0; i < len; ++i){
-        h = h ^ (unsigned char) key[i];
-        h = h * 1099511628211ULL; // FNV_PRIME 64 bit
+int hashmap_aggregator_init(HashMapAggregator *a, int nthreads, uint64_t num_els, hashmap_hash_function hash_function) {
+    #if defined (_OPENMP)
+    if (nthreads <= 0) {
+        nthreads = omp_get_max_threads();
     }
-    return h;
-}
-
-static int  __allocate_hashmap(HashMap *h, uint64_t num_els) {
-    hashmap_node** tmp = (hashmap_node**)realloc(h->nodes, num_els * sizeof(hashmap_node*));
-    if (tmp == NULL) {return HASHMAP_FAILURE;}
-    h->nodes = tmp;
-    uint64_t orig_num_els = h->number_nodes;
-    for (uint64_t i = orig_num_els; i < num_els; ++i) {
-        h->nodes[i] = NULL;
+    #endif
+    a->nthreads = (nthreads <= 0) ? 1 : nthreads;
+    void *locals;
+    if (posix_memalign(&locals, 64, a->nthreads * sizeof(struct hashmap_local)) != 0) {
+        a->locals = NULL;
+        return HASHMAP_FAILURE;
     }
-    h->number_nodes = num_els;
-    int q = 0;
-    // TODO: The math to see if this ever needs to be done more than once
-    while (q == 0) {
-        q = __relayout_nodes(h, 0, 1);
+    a->locals = (struct hashmap_local*)memset(locals, 0, a->nthreads * sizeof(struct hashmap_local));
+    for (int t = 0; t < a->nthreads; ++t) {
+        if (hashmap_init_alt(&a->locals[t].map, num_els, hash_function) == HASHMAP_FAILURE) {
+            a->nthreads = t;
+            hashmap_aggregator_destroy(a);
+            return HASHMAP_FAILURE;
+        }
     }
     return HASHMAP_SUCCESS;
 }
 
-static int __relayout_nodes(HashMap *h, uint64_t loc, short end_on_null) {
-    int moved_one = 1;
-    uint64_t i;
-    for (i = loc; i < h->number_nodes; ++i) {
-        if(h->nodes[i] != NULL) {
-            uint64_t id;
-            int error;
-            // ignore the return since we do not need it
-            __get_node(h, h->nodes[i]->key, h->nodes[i]->hash, &id, &error);
+HashMap* hashmap_aggregator_local(HashMapAggregator *a, int thread) {
+    return (thread < 0 || thread >= a->nthreads) ? NULL : &a->locals[thread].map;
+}
 
-            if (id != i) {
-                moved_one = 0;
-                h->nodes[id] = h->nodes[i];
-                h->nodes[i] = NULL;
-            }
-        } else if (end_on_null == 0 && i != loc) {
-            break;
-        }
-    }
-    return moved_one;
+#if !defined (_OPENMP) && defined (HASHMAP_PTHREADS)
+typedef struct __reduce_args {
+    HashMapAggregator *a;
+    HashMap *part;
+    uint64_t p, num_parts;
+    hashmap_merge_function combine;
+    void *ctx;
+    int res;
+} __reduce_args;
+
+static void* __reduce_thread(void *arg) {
+    __reduce_args *r = (__reduce_args*)arg;
+    r->res = __reduce_partition(r->a, r->part, r->p, r->num_parts, r->combine, r->ctx);
+    return NULL;
 }
+#endif
 
-static void* __get_node(HashMap *h, const char *key, uint64_t hash, uint64_t *i, int *error) {
-    *error = 0; // no errors
-    uint64_t idx = *i = hash % h->number_nodes;
-    size_t len = strlen(key);
-    while (1) {
-        if (h->nodes[*i] == NULL) { //not found
-            return NULL;
-        } else if (h->nodes[*i]->hash == hash && len == strlen(h->nodes[*i]->key) && strncmp(key, h->nodes[*i]->key, len) == 0) {
-            return  h->nodes[*i]->value;
-        } else {
-            // lets see if we need to continue or if we have already gone all the way around
-            *i = (*i + 1 == h->number_nodes) ? 0 : *i + 1;
-            if (*i == idx) {    // This can only have this happen if there are NO open locations
-                *error = -1;    // which signifies that the hashmap is full
-                return NULL;
+int hashmap_aggregator_reduce(HashMapAggregator *a, HashMap *dst, hashmap_merge_function combine, void *ctx) {
+    /*  Partition p gathers the keys with hash % num_parts == p from every
+        thread's map, so partitions never share a key and can be combined
+        concurrently without locks; they are then moved into dst. */
+    const uint64_t num_parts = a->nthreads;
+    uint64_t p, merged, total = 0;
+    int res = HASHMAP_SUCCESS;
+    for (int t = 0; t < a->nthreads; ++t) {
+        total += a->locals[t].map.used_nodes;
+    }
+    // dst releases the nodes so it must share the thread maps' allocator; it is grown before any move
+    if (dst->allocator != a->locals[0].map.allocator || __reserve_nodes(dst, dst->used_nodes + total) == HASHMAP_FAILURE) {
+        return HASHMAP_FAILURE;
+    }
+    HashMap *parts = (HashMap*)calloc(num_parts, sizeof(HashMap));
+    uint64_t *starts = (uint64_t*)malloc(num_parts * sizeof(uint64_t));  // open buckets of the thread maps, for __unreduce
+    if (parts == NULL || starts == NULL) {
+        free(parts);
+        free(starts);
+        return HASHMAP_FAILURE;
+    }
+    for (int t = 0; t < a->nthreads; ++t) {
+        starts[t] = __find_open_bucket(&a->locals[t].map);
+    }
+    for (p = 0; p < num_parts; ++p) {
+        if (hashmap_init_alt(&parts[p], total / num_parts / MAX_FULLNESS_PERCENT + 1024, a->locals[0].map.hash_function) == HASHMAP_FAILURE) {
+            while (p-- > 0) {  // nothing was moved yet so the thread maps are left as they are
+                hashmap_destroy(&parts[p]);
             }
+            free(parts);
+            free(starts);
+            return HASHMAP_FAILURE;
         }
     }
-}
-
-static void* __hashmap_set(HashMap *h, const char *key, void *value, short mallocd) {
-    // check to see if we need to expand the hashmap
-    if (__get_fullness(h) >= MAX_FULLNESS_PERCENT) {
-        uint64_t num_nodes = h->number_nodes;
-        __allocate_hashmap(h, num_nodes * 2);
+    #if defined (_OPENMP)
+    int64_t q;
+    #pragma omp parallel for num_threads(a->nthreads) schedule(static, 1) reduction(min:res)
+    for (q = 0; q < (int64_t)num_parts; ++q) {
+        int r = __reduce_partition(a, &parts[q], q, num_parts, combine, ctx);
+        res = (r < res) ? r : res;
     }
-    // get the hash value
-    uint64_t hash = h->hash_function(key);  // TODO: move out of this function to better parallelize
-    uint64_t i;
-    int error;
-    const void * tmp = __get_node(h, key, hash, &i, &error);
-    if (tmp == NULL && error == -1) {
-        fprintf(stderr, "Error: Unable to insert due to the hashmap being full\n");
-        return NULL;
-    } else  if (tmp != NULL) {
-        if (h->nodes[i]->mallocd != 0) {
-            void* v = h->nodes[i]->value;
-            h->nodes[i]->value = value;
-            return v;
+    #elif defined (HASHMAP_PTHREADS)
+    pthread_t *threads = (pthread_t*)malloc(num_parts * sizeof(pthread_t));
+    __reduce_args *args = (__reduce_args*)malloc(num_parts * sizeof(__reduce_args));
+    short *started = (short*)calloc(num_parts, sizeof(short));
+    const int threaded = (threads != NULL && args != NULL && started != NULL);
+    for (p = 0; p < num_parts && threaded; ++p) {
+        args[p].a = a;
+        args[p].part = &parts[p];
+        args[p].p = p;
+        args[p].num_parts = num_parts;
+        args[p].combine = combine;
+        args[p].ctx = ctx;
+        if (pthread_create(&threads[p], NULL, &__reduce_thread, &args[p]) == 0) {
+            started[p] = 1;
         } else {
-            free(h->nodes[i]->value);
-            h->nodes[i]->value = value;
+            __reduce_thread(&args[p]);  // every partition has to be reduced; do it here
         }
+    }
+    for (p = 0; p < num_parts && threaded; ++p) {
+        if (started[p] != 0) {
+            pthread_join(threads[p], NULL);
+        }
+        if (res == HASHMAP_SUCCESS && args[p].res == HASHMAP_FAILURE) {
+            res = HASHMAP_FAILURE;
+        }
+    }
+    for (p = 0; p < num_parts && !threaded && res == HASHMAP_SUCCESS; ++p) {  // no memory for the threads; reduce here
+        res = __reduce_partition(a, &parts[p], p, num_parts, combine, ctx);
+    }
+    free(threads);
+    free(args);
+    free(started);
+    #else
+    for (p = 0; p < num_parts && res == HASHMAP_SUCCESS; ++p) {
+        res = __reduce_partition(a, &parts[p], p, num_parts, combine, ctx);
+    }
+    #endif
+    for (merged = 0; merged < num_parts && res == HASHMAP_SUCCESS; ++merged) {
+        if (hashmap_merge(dst, &parts[merged], combine, ctx) == HASHMAP_FAILURE) {
+            res = HASHMAP_FAILURE;  // what is left of it stays in the partition
+            break;
+        }
+    }
+    if (res == HASHMAP_FAILURE) {  // nothing is lost; what did not reach dst goes back to the thread maps
+        __unreduce(a, parts + merged, num_parts - merged, starts, combine, ctx);
     } else {
-        __assign_node(h, key, value, mallocd, i, hash);
+        for (int t = 0; t < a->nthreads; ++t) {  // everything was moved out or combined away
+            hashmap_clear(&a->locals[t].map);
+        }
     }
-    return value;
+    for (p = 0; p < num_parts; ++p) {
+        if (parts[p].nodes != NULL) {
+            hashmap_destroy(&parts[p]);
+        }
+    }
+    free(parts);
+    free(starts);
+    return res;
 }
 
-static void  __assign_node(HashMap *h, const char *key, void *value, short mallocd, uint64_t i, uint64_t hash) {
-    int len = strlen(key);
-    h->nodes[i] = (hashmap_node*)malloc(sizeof(hashmap_node));
-    h->nodes[i]->key = (char*)calloc(len + 1, sizeof(char));
-    memcpy(h->nodes[i]->key, key, len);
-    h->nodes[i]->value = value;
-    h->nodes[i]->hash = hash;
+void hashmap_aggregator_destroy(HashMapAggregator *a) {
+    for (int t = 0; t < a->nthreads; ++t) {
+        hashmap_destroy(&a->locals[t].map);
+    }
+    free(a->locals);
+    a->locals = NULL;
+    a->nthreads = 0;
+}
+
+const char** hashmap_keys_sorted(const HashMap *h, int order, void ***values) {
+    uint64_t i, j = 0, n = h->used_nodes;
+    hashmap_node **nodes = (hashmap_node**)malloc((n + 1) * sizeof(hashmap_node*));
+    hashmap_node **tmp = (hashmap_node**)malloc((n + 1) * sizeof(hashmap_node*));
+    const char **keys = (const char**)malloc((n + 1) * sizeof(char*));
+    void **vals = (values == NULL) ? NULL : (void**)malloc((n + 1) * sizeof(void*));
+    if (nodes == NULL || tmp == NULL || keys == NULL || (values != NULL && vals == NULL)) {
+        free(nodes);
+        free(tmp);
+        free(keys);
+        free(vals);
+        return NULL;
+    }
+    for (i = 0; i < __num_buckets(h); ++i) {
+        if (__bucket(h, i) != NULL) {
+            nodes[j++] = __bucket(h, i);
+        }
+    }
+    if (order == HASHMAP_SORT_HASH) {
+        __sort_nodes_by_hash(nodes, tmp, n);
+    } else {
+        __sort_nodes_by_key(nodes, tmp, n, 0);
+    }
+    for (i = 0; i < n; ++i) {
+        keys[i] = nodes[i]->key;
+        if (vals != NULL) {
+            vals[i] = nodes[i]->value;
+        }
+    }
+    free(nodes);
+    free(tmp);
+    if (values != NULL) {
+        *values = vals;
+    }
+    return keys;
+}
+
+/*******************************************************************************
+***        STREAMING
+*******************************************************************************/
+
+int hashmap_write_stream(const HashMap *h, int fd, hashmap_value_encoder encoder, void *ctx) {
+    unsigned char *buf = (unsigned char*)malloc(STREAM_BUFFER_SIZE);
+    size_t scratch_size = 256, used = 0;
+    unsigned char *scratch = (unsigned char*)malloc(scratch_size);
+    unsigned char header[16];
+    int res = HASHMAP_SUCCESS;
+    if (buf == NULL || scratch == NULL) {
+        res = HASHMAP_FAILURE;
+    } else {
+        memcpy(header, STREAM_MAGIC, 4);
+        __put_u32(header + 4, STREAM_FORMAT_VERSION);
+        __put_u64(header + 8, h->used_nodes);
+        res = __stream_write(fd, buf, &used, header, 16);
+    }
+    for (uint64_t i = 0; i < __num_buckets(h) && res == HASHMAP_SUCCESS; ++i) {
+        if (__bucket(h, i) == NULL) {
+            continue;
+        }
+        const char *key = __bucket(h, i)->key;
+        const void *value = __bucket(h, i)->value;
+        size_t key_len = strlen(key), value_len;
+        const void *value_bytes = scratch;
+        if (encoder == NULL) {  // values are c-strings
+            value_len = (value == NULL) ? 0 : strlen((const char*)value);
+            value_bytes = value;
+        } else {
+            value_len = encoder(key, value, scratch, scratch_size, ctx);
+            if (value_len > scratch_size) {
+                if (__stream_grow(&scratch, &scratch_size, value_len) == HASHMAP_FAILURE) {
+                    res = HASHMAP_FAILURE;
+                    break;
+                }
+                value_len = encoder(key, value, scratch, scratch_size, ctx);
+            }
+        }
+        if (key_len > STREAM_MAX_LENGTH || value_len > STREAM_MAX_LENGTH) {
+            res = HASHMAP_FAILURE;
+            break;
+        }
+        unsigned char len[4];
+        __put_u32(len, (uint32_t)key_len);
+        res = __stream_write(fd, buf, &used, len, 4);
+        if (res == HASHMAP_SUCCESS) {res = __stream_write(fd, buf, &used, key, key_len);}
+        __put_u32(len, (encoder == NULL && value == NULL) ? STREAM_NULL_VALUE : (uint32_t)value_len);
+        if (res == HASHMAP_SUCCESS) {res = __stream_write(fd, buf, &used, len, 4);}
+        if (res == HASHMAP_SUCCESS) {res = __stream_write(fd, buf, &used, value_bytes, value_len);}
+    }
+    if (res == HASHMAP_SUCCESS) {
+        res = __stream_flush(fd, buf, used);
+    }
+    free(buf);
+    free(scratch);
+    return res;
+}
+
+int hashmap_read_stream(HashMap *h, int fd, hashmap_value_decoder decoder, void *ctx) {
+    unsigned char *buf = (unsigned char*)malloc(STREAM_BUFFER_SIZE);
+    size_t key_size = 256, value_size = 256, pos = 0, filled = 0;
+    unsigned char *key = (unsigned char*)malloc(key_size);
+    unsigned char *value = (unsigned char*)malloc(value_size);
+    unsigned char header[16];
+    uint64_t count = 0;
+    int res = HASHMAP_SUCCESS;
+    if (buf == NULL || key == NULL || value == NULL) {
+        res = HASHMAP_FAILURE;
+    } else {
+        res = __stream_read(fd, buf, &pos, &filled, header, 16);
+        // version 1 differs only in writing NULL values as empty strings
+        if (res == HASHMAP_SUCCESS && (memcmp(header, STREAM_MAGIC, 4) != 0 || __get_u32(header + 4) == 0 || __get_u32(header + 4) > STREAM_FORMAT_VERSION)) {
+            res = HASHMAP_FAILURE;
+        }
+    }
+    if (res == HASHMAP_SUCCESS) {
+        count = __get_u64(header + 8);
+        // size the table once from the header instead of growing as records arrive; the count is
+        // not trusted past STREAM_PRESIZE_MAX keys, after which the table grows as usual
+        res = __reserve_nodes(h, h->used_nodes + ((count < STREAM_PRESIZE_MAX) ? count : STREAM_PRESIZE_MAX));
+    }
+    for (uint64_t n = 0; n < count && res == HASHMAP_SUCCESS; ++n) {
+        unsigned char len[4];
+        uint32_t key_len, value_len = 0;
+        res = __stream_read(fd, buf, &pos, &filled, len, 4);
+        key_len = __get_u32(len);
+        if (res == HASHMAP_SUCCESS && key_len > STREAM_MAX_LENGTH) {res = HASHMAP_FAILURE;}
+        if (res == HASHMAP_SUCCESS) {res = __stream_read_grow(fd, buf, &pos, &filled, &key, &key_size, key_len);}
+        if (res == HASHMAP_SUCCESS && memchr(key, '\0', key_len) != NULL) {res = HASHMAP_FAILURE;}  // keys are c-strings
+        if (res == HASHMAP_SUCCESS) {res = __stream_read(fd, buf, &pos, &filled, len, 4);}
+        const int null_value = (res == HASHMAP_SUCCESS && __get_u32(len) == STREAM_NULL_VALUE);
+        if (res == HASHMAP_SUCCESS && !null_value) {
+            value_len = __get_u32(len);
+            res = (value_len > STREAM_MAX_LENGTH) ? HASHMAP_FAILURE : __stream_read_grow(fd, buf, &pos, &filled, &value, &value_size, value_len);
+        }
+        if (res != HASHMAP_SUCCESS) {
+            break;
+        }
+        void *v = NULL;  // NULL values are stored as is; the decoder is not called
+        uint64_t size = 0;
+        if (!null_value && decoder == NULL) {  // values are c-strings
+            v = __hm_calloc(h, value_len + 1, sizeof(char));
+            if (v != NULL) {memcpy(v, value, value_len);}
+            size = value_len + 1;
+        } else if (!null_value) {
+            v = decoder((const char*)key, value, value_len, ctx);
+            size = __value_size(h, v);
+        }
+        if (__hashmap_set(h, (const char*)key, v, 0, size, NULL) == NULL && v != NULL) {
+            res = HASHMAP_FAILURE;
+        }
+    }
+    free(buf);
+    free(key);
+    free(value);
+    return res;
+}
+
+/*******************************************************************************
+***        FROZEN MAPS
+*******************************************************************************/
+int hashmap_freeze(HashMap *h, HashMapFrozen *frozen) {
+    __migrate(h, UINT64_MAX);
+    uint64_t i, j, n = h->used_nodes, num_groups = n / 3 + 1;  // about three keys per group
+    uint64_t max_size = 0, key_bytes = 0;
+    hashmap_node **nodes = (hashmap_node**)malloc((n + 1) * sizeof(hashmap_node*));
+    uint64_t *starts = (uint64_t*)calloc(num_groups + 1, sizeof(uint64_t));
+    uint64_t *order = (uint64_t*)malloc(num_groups * sizeof(uint64_t));
+    uint8_t *taken = (uint8_t*)calloc(n + 1, sizeof(uint8_t));
+    frozen->entries = (hashmap_frozen_entry*)__hm_calloc(h, n + 1, sizeof(hashmap_frozen_entry));
+    frozen->displacements = (uint32_t*)__hm_calloc(h, num_groups, sizeof(uint32_t));
+    frozen->keys = NULL;
+    frozen->number_keys = n;
+    frozen->number_groups = num_groups;
+    frozen->hash_function = h->hash_function;
+    frozen->keyed_hash_function = h->keyed_hash_function;
+    frozen->seed[0] = h->seed[0];
+    frozen->seed[1] = h->seed[1];
+    frozen->allocator = h->allocator;
+    int res = HASHMAP_FAILURE;
+    if (nodes == NULL || starts == NULL || order == NULL || taken == NULL || frozen->entries == NULL || frozen->displacements == NULL) {
+        goto cleanup;
+    }
+
+    // counting sort the nodes into their groups
+    for (i = 0; i < h->number_nodes; ++i) {
+        if (h->nodes[i] != NULL) {
+            ++starts[h->nodes[i]->hash % num_groups + 1];
+            key_bytes += strlen(h->nodes[i]->key) + 1;
+        }
+    }
+    for (i = 0; i < num_groups; ++i) {
+        max_size = (starts[i + 1] > max_size) ? starts[i + 1] : max_size;
+        starts[i + 1] += starts[i];
+    }
+    {
+        uint64_t *next = (uint64_t*)malloc(num_groups * sizeof(uint64_t));
+        uint64_t *by_size = (uint64_t*)calloc(max_size + 2, sizeof(uint64_t));
+        if (next == NULL || by_size == NULL) {
+            free(next);
+            free(by_size);
+            goto cleanup;
+        }
+        memcpy(next, starts, num_groups * sizeof(uint64_t));
+        for (i = 0; i < h->number_nodes; ++i) {
+            if (h->nodes[i] != NULL) {
+                nodes[next[h->nodes[i]->hash % num_groups]++] = h->nodes[i];
+            }
+        }
+        // the largest groups are placed first, while most entries are still open
+        for (i = 0; i < num_groups; ++i) {
+            ++by_size[max_size - (starts[i + 1] - starts[i]) + 1];
+        }
+        for (i = 0; i <= max_size; ++i) {
+            by_size[i + 1] += by_size[i];
+        }
+        for (i = 0; i < num_groups; ++i) {
+            order[by_size[max_size - (starts[i + 1] - starts[i])]++] = i;
+        }
+        free(next);
+        free(by_size);
+    }
+
+    {
+        uint64_t *slots = (uint64_t*)malloc((max_size + 1) * sizeof(uint64_t));
+        if (slots == NULL) {goto cleanup;}
+        for (i = 0; i < num_groups; ++i) {
+            uint64_t g = order[i], size = starts[g + 1] - starts[g];
+            if (size == 0) {
+                break;  // the rest are empty too
+            }
+            if (__frozen_place(frozen, nodes + starts[g], size, g, taken, slots) == HASHMAP_FAILURE) {
+                free(slots);
+                goto cleanup;
+            }
+        }
+        free(slots);
+    }
+
+    frozen->keys = (char*)__hm_malloc(h, key_bytes + 1);
+    if (frozen->keys == NULL) {goto cleanup;}
+    // nothing can fail from here on; copy the keys and move the values over
+    for (i = 0, j = 0; i < n; ++i) {
+        hashmap_frozen_entry *e = &frozen->entries[i];
+        hashmap_node *node = (hashmap_node*)e->key;  // parked by __frozen_place
+        size_t len = strlen(node->key) + 1;
+        memcpy(frozen->keys + j, node->key, len);
+        e->key = frozen->keys + j;
+        e->value = node->value;
+        e->hash = node->hash;
+        e->mallocd = node->mallocd;
+        node->mallocd = -1;
+        j += len;
+    }
+    for (i = 0; i < h->number_nodes; ++i) {
+        if (h->nodes[i] != NULL) {
+            __free_node(h, h->nodes[i]);
+            h->nodes[i] = NULL;
+        }
+    }
+    h->used_nodes = 0;
+    __bloom_reset(h);
+    h->value_bytes = 0;  // the values were moved out without being counted off
+    h->alloc_overhead = 0;
+    res = HASHMAP_SUCCESS;
+
+cleanup:
+    free(nodes);
+    free(starts);
+    free(order);
+    free(taken);
+    if (res == HASHMAP_FAILURE) {
+        __hm_free(h, frozen->entries);
+        __hm_free(h, frozen->displacements);
+        __hm_free(h, frozen->keys);
+        frozen->entries = NULL;
+        frozen->displacements = NULL;
+        frozen->keys = NULL;
+        frozen->number_keys = 0;
+    }
+    return res;
+}
+
+void* hashmap_frozen_get(const HashMapFrozen *frozen, const char *key) {
+    if (frozen->number_keys == 0) {return NULL;}
+    uint64_t hash = (frozen->keyed_hash_function != NULL) ? frozen->keyed_hash_function(key, frozen->seed) : frozen->hash_function(key);
+    uint32_t d = frozen->displacements[hash % frozen->number_groups];
+    const hashmap_frozen_entry *e = &frozen->entries[__frozen_slot(hash, d, frozen->number_keys)];
+    if (e->hash == hash && strcmp(e->key, key) == 0) {
+        return e->value;
+    }
+    return NULL;
+}
+
+void hashmap_frozen_destroy(HashMapFrozen *frozen) {
+    const hashmap_allocator *a = frozen->allocator;
+    void *ptrs[3] = {frozen->entries, frozen->displacements, frozen->keys};
+    for (uint64_t i = 0; i < frozen->number_keys; ++i) {
+        if (frozen->entries[i].mallocd == 0) {
+            if (a == NULL) {
+                free(frozen->entries[i].value);
+            } else {
+                a->free_fn(frozen->entries[i].value, a->ctx);
+            }
+        }
+    }
+    for (int k = 0; k < 3; ++k) {
+        if (a == NULL) {
+            free(ptrs[k]);
+        } else {
+            a->free_fn(ptrs[k], a->ctx);
+        }
+    }
+    frozen->entries = NULL;
+    frozen->displacements = NULL;
+    frozen->keys = NULL;
+    frozen->number_keys = 0;
+}
+
+/*******************************************************************************
+***        COMPACT MAPS
+*******************************************************************************/
+int hashmap_compact_init(HashMapCompact *c, uint64_t num_els, hashmap_hash_function hash_function) {
+    c->index = NULL;
+    c->entries = NULL;
+    c->number_slots = 0;
+    c->number_entries = 0;
+    c->used_nodes = 0;
+    c->hash_function = (hash_function == NULL) ? &default_hash : hash_function;
+    c->index_width = 1;
+    return __compact_resize(c, (num_els < 8) ? 8 : num_els);
+}
+
+void hashmap_compact_destroy(HashMapCompact *c) {
+    for (uint64_t j = 0; j < c->number_entries; ++j) {
+        free(c->entries[j].key);
+    }
+    free(c->entries);
+    free(c->index);
+    c->index = NULL;
+    c->entries = NULL;
+    c->number_slots = 0;
+    c->number_entries = 0;
+    c->used_nodes = 0;
+}
+
+void* hashmap_compact_set(HashMapCompact *c, const char *key, void *value) {
+    uint64_t slot, hash = c->hash_function(key);
+    int64_t pos = __compact_find(c, key, hash, &slot);
+    if (pos >= 0) {
+        void *v = c->entries[pos].value;
+        c->entries[pos].value = value;
+        return v;
+    }
+    if (c->number_entries == c->number_slots / 2) {  // the entries array is full
+        uint64_t num_slots = c->number_slots;
+        while ((c->used_nodes + 1) * 4 > num_slots) {  // otherwise dropping the removed entries is enough
+            num_slots *= 2;
+        }
+        if (__compact_resize(c, num_slots) == HASHMAP_FAILURE) {return NULL;}
+        __compact_find(c, key, hash, &slot);
+    }
+    int len = strlen(key);
+    char *k = (char*)malloc(len + 1);
+    if (k == NULL) {return NULL;}
+    memcpy(k, key, len + 1);
+    hashmap_compact_entry *e = &c->entries[c->number_entries];
+    e->key = k;
+    e->value = value;
+    e->hash = hash;
+    __compact_set_slot(c, slot, c->number_entries++);
+    ++c->used_nodes;
+    return value;
+}
+
+void* hashmap_compact_get(const HashMapCompact *c, const char *key) {
+    uint64_t slot;
+    int64_t pos = __compact_find(c, key, c->hash_function(key), &slot);
+    return (pos < 0) ? NULL : c->entries[pos].value;
+}
+
+void* hashmap_compact_remove(HashMapCompact *c, const char *key) {
+    uint64_t slot;
+    int64_t pos = __compact_find(c, key, c->hash_function(key), &slot);
+    if (pos < 0) {return NULL;}
+    // the index slot cannot be emptied without breaking the probe of later keys
+    __compact_set_slot(c, slot, COMPACT_REMOVED);
+    free(c->entries[pos].key);
+    c->entries[pos].key = NULL;
+    --c->used_nodes;
+    return c->entries[pos].value;
+}
+
+void hashmap_compact_for_each(const HashMapCompact *c, hashmap_visit_function fn, void *ctx) {
+    for (uint64_t j = 0; j < c->number_entries; ++j) {
+        if (c->entries[j].key != NULL) {
+            fn(c->entries[j].key, c->entries[j].value, ctx);
+        }
+    }
+}
+
+char** hashmap_compact_keys(const HashMapCompact *c) {
+    char** keys = (char**)calloc(c->used_nodes, sizeof(char*));
+    uint64_t i = 0;
+    for (uint64_t j = 0; j < c->number_entries; ++j) {
+        if (c->entries[j].key != NULL) {
+            int len = strlen(c->entries[j].key);
+            keys[i] = (char*)calloc(len + 1, sizeof(char));
+            memcpy(keys[i], c->entries[j].key, len);
+            ++i;
+        }
+    }
+    return keys;
+}
+
+/*******************************************************************************
+***        UTILITY INSERTS
+*******************************************************************************/
+
+int* hashmap_set_int(HashMap *h, const char *key, const int value) {
+    int *ptr = (int*)__hm_malloc(h, sizeof(int));
+    *ptr = value;
+    return (int*)__hashmap_set(h, key, (void*)ptr, 0, sizeof(int), NULL);
+}
+
+long* hashmap_set_long(HashMap *h, const char *key, const long value) {
+    long *ptr = (long*)__hm_malloc(h, sizeof(long));
+    *ptr = value;
+    return (long*)__hashmap_set(h, key, (void*)ptr, 0, sizeof(long), NULL);
+}
+
+char* hashmap_set_string(HashMap *h, const char *key, const char *value) {
+    int len = strlen(value);
+    char *ptr = (char*)__hm_calloc(h, len + 1, sizeof(char));
+    memcpy(ptr, value, len);
+    return (char*)__hashmap_set(h, key, (void*)ptr, 0, len + 1, NULL);
+}
+
+float* hashmap_set_float(HashMap *h, const char *key, const float value) {
+    float *ptr = (float*)__hm_malloc(h, sizeof(float));
+    *ptr = value;
+    return (float*)__hashmap_set(h, key, (void*)ptr, 0, sizeof(float), NULL);
+}
+
+double* hashmap_set_double(HashMap *h, const char *key, const double value) {
+    double *ptr = (double*)__hm_malloc(h, sizeof(double));
+    *ptr = value;
+    return (double*)__hashmap_set(h, key, ptr, 0, sizeof(double), NULL);
+}
+
+/*******************************************************************************
+***        PRIVATE FUNCTIONS
+*******************************************************************************/
+static uint64_t default_hash(const char *key) { // FNV-1a hash (http://www.isthe.com/chongo/tech/comp/fnv/)
+    int i, len = strlen(key);
+    uint64_t h = 14695981039346656037ULL; // FNV_OFFSET 64 bit
+    for (i = 0; i < len; ++i){
+        h = h ^ (unsigned char) key[i];
+        h = h * 1099511628211ULL; // FNV_PRIME 64 bit
+    }
+    return h;
+}
+
+/* SipHash-2-4 (https://www.aumasson.jp/siphash/siphash.pdf) */
+#define SIPHASH_ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+#define SIPHASH_ROUND(v0, v1, v2, v3) do { \
+        v0 += v1; v1 = SIPHASH_ROTL(v1, 13); v1 ^= v0; v0 = SIPHASH_ROTL(v0, 32); \
+        v2 += v3; v3 = SIPHASH_ROTL(v3, 16); v3 ^= v2; \
+        v0 += v3; v3 = SIPHASH_ROTL(v3, 21); v3 ^= v0; \
+        v2 += v1; v1 = SIPHASH_ROTL(v1, 17); v1 ^= v2; v2 = SIPHASH_ROTL(v2, 32); \
+    } while (0)
+
+uint64_t hashmap_siphash(const char *key, const uint64_t seed[2]) {
+    const unsigned char *in = (const unsigned char*)key;
+    size_t i, len = strlen(key);
+    uint64_t v0 = 0x736f6d6570736575ULL ^ seed[0];
+    uint64_t v1 = 0x646f72616e646f6dULL ^ seed[1];
+    uint64_t v2 = 0x6c7967656e657261ULL ^ seed[0];
+    uint64_t v3 = 0x7465646279746573ULL ^ seed[1];
+    uint64_t m, b = ((uint64_t)len) << 56;
+    const size_t end = len - (len % 8);
+
+    for (i = 0; i < end; i += 8) {
+        m = (uint64_t)in[i] | ((uint64_t)in[i + 1] << 8) | ((uint64_t)in[i + 2] << 16) | ((uint64_t)in[i + 3] << 24) |
+            ((uint64_t)in[i + 4] << 32) | ((uint64_t)in[i + 5] << 40) | ((uint64_t)in[i + 6] << 48) | ((uint64_t)in[i + 7] << 56);
+        v3 ^= m;
+        SIPHASH_ROUND(v0, v1, v2, v3);
+        SIPHASH_ROUND(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+    for (i = 0; i < len % 8; ++i) { // the remaining bytes
+        b |= ((uint64_t)in[end + i]) << (8 * i);
+    }
+    v3 ^= b;
+    SIPHASH_ROUND(v0, v1, v2, v3);
+    SIPHASH_ROUND(v0, v1, v2, v3);
+    v0 ^= b;
+    v2 ^= 0xff;
+    SIPHASH_ROUND(v0, v1, v2, v3);
+    SIPHASH_ROUND(v0, v1, v2, v3);
+    SIPHASH_ROUND(v0, v1, v2, v3);
+    SIPHASH_ROUND(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+static inline uint64_t __hash_key(const HashMap *h, const char *key) {
+    return (h->keyed_hash_function != NULL) ? h->keyed_hash_function(key, h->seed) : h->hash_function(key);
+}
+
+static void __random_seed(uint64_t seed[2]) {
+    static uint64_t counter = 0;
+    FILE *fp = fopen("/dev/urandom", "rb");
+    if (fp != NULL) {
+        size_t n = fread(seed, sizeof(uint64_t), 2, fp);
+        fclose(fp);
+        if (n == 2) {
+            return;
+        }
+    }
+    // no system randomness available; mix what differs between calls and runs (splitmix64)
+    uint64_t x = (uint64_t)time(NULL) ^ ((uint64_t)clock() << 32) ^ (uint64_t)(uintptr_t)seed ^ (++counter * 0x9e3779b97f4a7c15ULL);
+    for (int i = 0; i < 2; ++i) {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        seed[i] = z ^ (z >> 31);
+    }
+}
+
+/* pick a new seed and re-hash every key with it */
+static int __reseed(HashMap *h) {
+    __migrate(h, UINT64_MAX);
+    __random_seed(h->seed);
+    for (uint64_t i = 0; i < h->number_nodes; ++i) {
+        if (h->nodes[i] != NULL) {
+            h->nodes[i]->hash = __hash_key(h, h->nodes[i]->key);
+        }
+    }
+    return __rebuild_nodes(h, h->number_nodes);
+}
+
+static int __init_hashmap(HashMap *h, uint64_t num_els, hashmap_hash_function hash_function, int flags, const hashmap_allocator *allocator) {
+    h->allocator = allocator;
+    h->alloc_flags = flags;
+    h->engine = HASHMAP_LINEAR_PROBING;
+    h->nodes = __alloc_buckets(h, num_els, &h->buckets_mapped);
+    if (h->nodes == NULL) {return HASHMAP_FAILURE;}
+    h->tags = (uint8_t*)__hm_calloc(h, num_els, sizeof(uint8_t));
+    if (h->tags == NULL) {
+        __free_buckets(h, h->nodes, num_els, h->buckets_mapped);
+        return HASHMAP_FAILURE;
+    }
+    h->number_nodes = num_els;
+    h->used_nodes = 0;
+    h->hash_function = (hash_function == NULL) ? &default_hash : hash_function;
+    h->keyed_hash_function = NULL;
+    h->seed[0] = h->seed[1] = 0;
+    h->intern_pool = NULL;
+    h->capacity = 0;
+    h->clock_hand = 0;
+    h->evict = NULL;
+    h->evict_ctx = NULL;
+    h->clock = NULL;
+    h->expire_cursor = 0;
+    h->incremental = 0;
+    h->old_nodes = NULL;
+    h->old_tags = NULL;
+    h->old_number_nodes = 0;
+    h->migrate_start = 0;
+    h->migrated = 0;
+    h->old_buckets_mapped = 0;
+    h->node_bytes = 0;
+    h->key_bytes = 0;
+    h->value_bytes = 0;
+    h->alloc_overhead = 0;
+    h->bloom = NULL;
+    h->bloom_alloc = NULL;
+    h->bloom_blocks = 0;
+    h->bloom_removed = 0;
+    h->bloom_next = NULL;
+    h->bloom_next_alloc = NULL;
+    h->bloom_next_blocks = 0;
+    return HASHMAP_SUCCESS;
+}
+
+/*  A zeroed bucket array. Large arrays are mmap'd when huge pages or NUMA
+    interleaving are requested, falling back to calloc when mmap fails; `mapped`
+    records which one was used so it can be released correctly. */
+static hashmap_node** __alloc_buckets(const HashMap *h, uint64_t num_els, short *mapped) {
+    size_t bytes = num_els * sizeof(hashmap_node*);
+    *mapped = 0;
+    if ((h->alloc_flags & (HASHMAP_HUGE_PAGES | HASHMAP_NUMA_INTERLEAVE)) != 0 && bytes >= HUGE_PAGE_SIZE) {
+        size_t len = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        void *p = MAP_FAILED;
+        #if defined (MAP_HUGETLB)
+        if ((h->alloc_flags & HASHMAP_HUGE_PAGES) != 0) {  // needs pages reserved by the administrator
+            p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        }
+        #endif
+        if (p == MAP_FAILED) {
+            p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            #if defined (MADV_HUGEPAGE)
+            if (p != MAP_FAILED && (h->alloc_flags & HASHMAP_HUGE_PAGES) != 0) {  // transparent huge pages
+                madvise(p, len, MADV_HUGEPAGE);
+            }
+            #endif
+        }
+        if (p != MAP_FAILED) {
+            if ((h->alloc_flags & HASHMAP_NUMA_INTERLEAVE) != 0) {
+                __numa_interleave(p, len);
+            }
+            *mapped = 1;
+            return (hashmap_node**)p;
+        }
+    }
+    return (hashmap_node**)__hm_calloc(h, num_els, sizeof(hashmap_node*));
+}
+
+static void __free_buckets(const HashMap *h, hashmap_node **nodes, uint64_t num_els, short mapped) {
+    if (mapped != 0) {
+        size_t bytes = num_els * sizeof(hashmap_node*);
+        munmap(nodes, (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE);
+    } else {
+        __hm_free(h, nodes);
+    }
+}
+
+/* every node, key, value and bucket array allocation goes through these */
+static inline void* __hm_malloc(const HashMap *h, size_t size) {
+    return (h->allocator == NULL) ? malloc(size) : h->allocator->malloc_fn(size, h->allocator->ctx);
+}
+
+static inline void* __hm_calloc(const HashMap *h, size_t num, size_t size) {
+    return (h->allocator == NULL) ? calloc(num, size) : h->allocator->calloc_fn(num, size, h->allocator->ctx);
+}
+
+static inline void* __hm_realloc(const HashMap *h, void *ptr, size_t size) {
+    return (h->allocator == NULL) ? realloc(ptr, size) : h->allocator->realloc_fn(ptr, size, h->allocator->ctx);
+}
+
+static inline void __hm_free(const HashMap *h, void *ptr) {
+    if (h->allocator == NULL) {
+        free(ptr);
+    } else {
+        h->allocator->free_fn(ptr, h->allocator->ctx);
+    }
+}
+
+/*  spread the (not yet touched) pages round robin over the online NUMA nodes;
+    best effort, the kernel's default placement is kept on any failure */
+static void __numa_interleave(void *addr, size_t len) {
+    #if defined (__linux__) && defined (SYS_mbind)
+    unsigned long mask = 0;
+    int lo, hi;
+    char sep;
+    FILE *fp = fopen("/sys/devices/system/node/online", "r");  // e.g. "0-1" or "0,2-3"
+    if (fp == NULL) {return;}
+    while (fscanf(fp, "%d", &lo) == 1) {
+        hi = lo;
+        if (fscanf(fp, "%c", &sep) == 1 && sep == '-') {
+            if (fscanf(fp, "%d", &hi) != 1) {break;}
+            if (fscanf(fp, "%c", &sep) != 1) {sep = '\n';}
+        }
+        for (int n = lo; n <= hi && n < (int)(8 * sizeof(mask)); ++n) {
+            mask |= 1UL << n;
+        }
+        if (sep != ',') {break;}
+    }
+    fclose(fp);
+    if ((mask & (mask - 1)) != 0) {  // more than one node
+        syscall(SYS_mbind, addr, len, 3 /* MPOL_INTERLEAVE */, &mask, 8 * sizeof(mask) + 1, 0);
+    }
+    #else
+    (void)addr;
+    (void)len;
+    #endif
+}
+
+/* place every node into a new array of `num_els` buckets using the stored hash */
+static int __rebuild_nodes(HashMap *h, uint64_t num_els) {
+    __migrate(h, UINT64_MAX);
+    short mapped;
+    hashmap_node** tmp = __alloc_buckets(h, num_els, &mapped);
+    if (tmp == NULL) {return HASHMAP_FAILURE;}
+    uint8_t *tmp_tags = (uint8_t*)__hm_calloc(h, num_els, sizeof(uint8_t));
+    if (tmp_tags == NULL) {
+        __free_buckets(h, tmp, num_els, mapped);
+        return HASHMAP_FAILURE;
+    }
+    hashmap_node** old = h->nodes;
+    uint8_t *old_tags = h->tags;
+    uint64_t old_num_els = h->number_nodes;
+    short old_mapped = h->buckets_mapped;
+    h->nodes = tmp;
+    h->tags = tmp_tags;
+    h->buckets_mapped = mapped;
+    h->number_nodes = num_els;
+    for (uint64_t j = 0; j < old_num_els; ++j) {
+        if (old[j] != NULL && __place_node(h, old[j]) == HASHMAP_FAILURE) {
+            // only cuckoo placement can fail; start over with twice the room
+            __free_buckets(h, tmp, num_els, mapped);
+            __hm_free(h, tmp_tags);
+            h->nodes = old;
+            h->tags = old_tags;
+            h->buckets_mapped = old_mapped;
+            h->number_nodes = old_num_els;
+            return __rebuild_nodes(h, num_els * 2);
+        }
+    }
+    __free_buckets(h, old, old_num_els, old_mapped);
+    __hm_free(h, old_tags);
+    if (h->bloom != NULL) {
+        __bloom_build(h);  // sized for the new table
+    }
+    return HASHMAP_SUCCESS;
+}
+
+/* put a node whose key is not in the hashmap into an open slot */
+static int __place_node(HashMap *h, hashmap_node *node) {
+    uint64_t i;
+    if (h->engine == HASHMAP_CUCKOO) {
+        uint64_t b[2];
+        __cuckoo_buckets(h, node->hash, &b[0], &b[1]);
+        for (int k = 0; k < 2; ++k) {
+            for (i = b[k] * CUCKOO_SLOTS; i < (b[k] + 1) * CUCKOO_SLOTS; ++i) {
+                if (h->nodes[i] == NULL) {
+                    __put_node(h, i, node);
+                    return HASHMAP_SUCCESS;
+                }
+            }
+        }
+        if (__cuckoo_make_room(h, node->hash, &i) == HASHMAP_FAILURE) {return HASHMAP_FAILURE;}
+        __put_node(h, i, node);
+        return HASHMAP_SUCCESS;
+    }
+    i = node->hash % h->number_nodes;
+    while (h->nodes[i] != NULL) {
+        i = (i + 1 == h->number_nodes) ? 0 : i + 1;
+    }
+    __put_node(h, i, node);
+    return HASHMAP_SUCCESS;
+}
+
+/* grow the bucket array, once, so that `num_keys` fit below the max fullness */
+static int __reserve_nodes(HashMap *h, uint64_t num_keys) {
+    uint64_t num_els = h->number_nodes;
+    while (num_keys / (float)num_els >= __max_fullness(h)) {
+        num_els *= 2;
+    }
+    return (num_els == h->number_nodes) ? HASHMAP_SUCCESS : __rebuild_nodes(h, num_els);
+}
+
+static int  __allocate_hashmap(HashMap *h, uint64_t num_els) {
+    if (h->engine == HASHMAP_CUCKOO) {  // nodes have to be re-placed by their two buckets
+        return __rebuild_nodes(h, num_els);
+    }
+    uint64_t orig_num_els = h->number_nodes;
+    uint8_t *tags = (uint8_t*)__hm_realloc(h, h->tags, num_els * sizeof(uint8_t));
+    if (tags == NULL) {return HASHMAP_FAILURE;}
+    h->tags = tags;
+    if (h->alloc_flags == 0) {
+        hashmap_node** tmp = (hashmap_node**)__hm_realloc(h, h->nodes, num_els * sizeof(hashmap_node*));
+        if (tmp == NULL) {return HASHMAP_FAILURE;}
+        h->nodes = tmp;
+        for (uint64_t i = orig_num_els; i < num_els; ++i) {
+            h->nodes[i] = NULL;
+        }
+    } else {
+        short mapped;
+        hashmap_node** tmp = __alloc_buckets(h, num_els, &mapped);
+        if (tmp == NULL) {return HASHMAP_FAILURE;}
+        memcpy(tmp, h->nodes, orig_num_els * sizeof(hashmap_node*));
+        __free_buckets(h, h->nodes, orig_num_els, h->buckets_mapped);
+        h->nodes = tmp;
+        h->buckets_mapped = mapped;
+    }
+    h->number_nodes = num_els;
+    int q = 0;
+    // TODO: The math to see if this ever needs to be done more than once
+    while (q == 0) {
+        q = __relayout_nodes(h, 0, 1);
+    }
+    if (h->bloom != NULL) {
+        __bloom_build(h);  // sized for the new table
+    }
+    return HASHMAP_SUCCESS;
+}
+
+static int __relayout_nodes(HashMap *h, uint64_t loc, short end_on_null) {
+    int moved_one = 1;
+    uint64_t i;
+    for (i = loc; i < h->number_nodes; ++i) {
+        if(h->nodes[i] != NULL) {
+            uint64_t id;
+            int error;
+            // ignore the return since we do not need it
+            __get_node(h, h->nodes[i]->key, h->nodes[i]->hash, &id, &error);
+
+            if (id != i) {
+                moved_one = 0;
+                __move_node(h, id, i);
+            }
+        } else if (end_on_null == 0 && i != loc) {
+            break;
+        }
+    }
+    return moved_one;
+}
+
+static void* __get_node(HashMap *h, const char *key, uint64_t hash, uint64_t *i, int *error) {
+    if (h->engine == HASHMAP_CUCKOO) {
+        return __cuckoo_get_node(h, key, hash, i, error);
+    }
+    *error = 0; // no errors
+    uint64_t idx = *i = hash % h->number_nodes;
+    size_t len = strlen(key);
+    uint8_t tag = __tag(hash);
+    while (1) {
+        if (h->nodes[*i] == NULL) { //not found
+            return NULL;
+        } else if (h->tags[*i] == tag && h->nodes[*i]->key == key) {  // interned keys can be compared by pointer
+            return  h->nodes[*i]->value;
+        } else if (h->tags[*i] == tag && h->nodes[*i]->hash == hash && len == strlen(h->nodes[*i]->key) && strncmp(key, h->nodes[*i]->key, len) == 0) {
+            return  h->nodes[*i]->value;
+        } else {    // the tag lets most other keys be skipped without reading their node
+            // lets see if we need to continue or if we have already gone all the way around
+            *i = (*i + 1 == h->number_nodes) ? 0 : *i + 1;
+            if (*i == idx) {    // This can only have this happen if there are NO open locations
+                *error = -1;    // which signifies that the hashmap is full
+                return NULL;
+            }
+        }
+    }
+}
+
+/* the node of the key for a lookup, or NULL if it is not present */
+static hashmap_node* __lookup_node(HashMap *h, const char *key) {
+    uint64_t i, hash = __hash_key(h, key);
+    int e;
+    if (!__bloom_may_contain(h, hash)) {return NULL;}
+    __get_node(h, key, hash, &i, &e);
+    hashmap_node *node = (e == 0) ? h->nodes[i] : NULL;
+    if (node == NULL && h->old_nodes != NULL) {  // not moved yet; lookups leave the resize to writers
+        i = __find_old(h, key, hash);
+        node = (i == UINT64_MAX) ? NULL : h->old_nodes[i];
+    }
+    if (node == NULL || __is_expired(h, node)) {return NULL;}  // expired nodes are left for a writer to reclaim
+    if (h->capacity != 0) {
+        __mark_referenced(node);  // only caches pay for the write
+    }
+    return node;
+}
+
+static void* __hashmap_set(HashMap *h, const char *key, void *value, short mallocd, uint64_t value_size, const uint64_t *expiry) {
+    int inserted;
+    hashmap_node *node = __get_or_insert_node(h, key, __hash_key(h, key), mallocd, &inserted, expiry != NULL);
+    if (node == NULL) {
+        return NULL;
+    }
+    return __replace_value(h, node, inserted, value, value_size, expiry);
+}
+
+/*  Set the value of a node returned by __get_or_insert_node; returns what
+    hashmap_set returns, the previous value if the user owned it or else the
+    new value */
+static void* __replace_value(HashMap *h, hashmap_node *node, int inserted, void *value, uint64_t value_size, const uint64_t *expiry) {
+    if (node->expires != 0) {  // setting a key without an expiry clears it
+        ((hashmap_ttl_node*)node)->expiry = (expiry == NULL) ? UINT64_MAX : *expiry;
+    }
+    void *ret = value;
+    __account_value(h, node, -1);
+    if (inserted == 0) {
+        if (node->mallocd != 0) {
+            ret = node->value;
+        } else {
+            __hm_free(h, node->value);
+        }
+    }
+    node->value = value;
+    node->multi = 0;  // a single value replaces a multimap block
+    node->value_size = (node->mallocd != 0) ? 0 : (value_size > UINT32_MAX) ? UINT32_MAX : (uint32_t)value_size;
+    __account_value(h, node, 1);
+    return ret;
+}
+
+/*  Single hash and probe for the key; if it is not present a node with a NULL
+    value is added in the open slot found by the probe */
+static hashmap_node* __get_or_insert_node(HashMap *h, const char *key, uint64_t hash, short mallocd, int *inserted, short expires) {
+    // check to see if we need to expand the hashmap
+    if (__get_fullness(h) >= __max_fullness(h)) {
+        uint64_t num_nodes = h->number_nodes;
+        if (h->incremental != 0) {
+            __migrate(h, UINT64_MAX);  // only happens if growing outpaces the migration
+            __start_resize(h, num_nodes * 2);
+        } else {
+            __allocate_hashmap(h, num_nodes * 2);
+        }
+    }
+    __settle_key(h, key, hash);
+    uint64_t i;
+    int error;
+    __get_node(h, key, hash, &i, &error);
+    if (error == 0 && h->nodes[i] != NULL && __is_expired(h, h->nodes[i])) {
+        __expire_node(h, i);  // it is replaced by a new node
+        __get_node(h, key, hash, &i, &error);
+    }
+    if (h->capacity != 0 && h->used_nodes >= h->capacity && (error == -1 || h->nodes[i] == NULL)) {
+        __evict_node(h);  // a full cache; evicting may move nodes so probe again
+        __get_node(h, key, hash, &i, &error);
+    }
+    if (h->engine == HASHMAP_CUCKOO) {
+        while (error == -1) {  // both buckets are full; displace nodes or grow
+            if (__cuckoo_make_room(h, hash, &i) == HASHMAP_SUCCESS) {
+                error = 0;
+            } else if (__rebuild_nodes(h, h->number_nodes * 2) == HASHMAP_FAILURE) {
+                break;
+            } else {
+                __get_node(h, key, hash, &i, &error);
+            }
+        }
+    } else if (h->keyed_hash_function != NULL && (error == -1 || __calc_big_o(h->number_nodes, i, hash % h->number_nodes) > HASHMAP_MAX_PROBE_LENGTH)) {
+        // the cluster is abnormally long; with a keyed hash a new seed breaks it up
+        if (__reseed(h) == HASHMAP_SUCCESS) {
+            hash = __hash_key(h, key);
+            __get_node(h, key, hash, &i, &error);
+        }
+    }
+    if (error == -1) {
+        fprintf(stderr, "Error: Unable to insert due to the hashmap being full\n");
+        return NULL;
+    }
+    // the probe stops on either the matching node or the first open slot
+    *inserted = (h->nodes[i] == NULL);
+    if (*inserted) {
+        if (__assign_node(h, key, NULL, mallocd, i, hash, expires) == HASHMAP_FAILURE) {
+            *inserted = 0;
+            return NULL;
+        }
+        return h->nodes[i];
+    }
+    if (h->capacity != 0) {
+        h->nodes[i]->referenced = 1;
+    }
+    if (expires != 0) {  // the node already has room for the expiry
+        h->nodes[i]->expires = 1;
+    }
+    return h->nodes[i];
+}
+
+/*  first open bucket; with the fullness kept below MAX_FULLNESS_PERCENT there
+    is always one */
+static uint64_t __find_open_bucket(const HashMap *h) {
+    uint64_t i = 0;
+    while (i < h->number_nodes && h->nodes[i] != NULL) {
+        ++i;
+    }
+    return i;
+}
+
+/*  After removing nodes, move every remaining node to the first open bucket
+    from its home bucket. `start` must have been open before the removals so
+    that no cluster wraps past it; then a single pass in probe order visits the
+    nodes of each cluster after everything that they could have probed over. */
+static void __compact_nodes(HashMap *h, uint64_t start) {
+    uint64_t n = h->number_nodes, i = start;
+    if (start >= n || h->engine == HASHMAP_CUCKOO) {return;}  // cuckoo lookups do not stop at open slots
+    for (uint64_t k = 1; k < n; ++k) {
+        i = (i + 1 == n) ? 0 : i + 1;
+        if (h->nodes[i] == NULL) {
+            continue;
+        }
+        uint64_t j = h->nodes[i]->hash % n;
+        while (j != i && h->nodes[j] != NULL) {
+            j = (j + 1 == n) ? 0 : j + 1;
+        }
+        if (j != i) {
+            __move_node(h, j, i);
+        }
+    }
+}
+
+/* free the key, the value if the hashmap owns it, and the node itself */
+static void __free_node(HashMap *h, hashmap_node *node) {
+    __account_node(h, node, -1);
+    __release_key(h, node->key);
+    if (node->mallocd == 0) {
+        __hm_free(h, node->value);
+    }
+    __hm_free(h, node);
+}
+
+/* remove the node in bucket i and re-layout the rest of its cluster */
+static void __remove_node(HashMap *h, uint64_t i) {
+    __free_node(h, h->nodes[i]);
+    h->nodes[i] = NULL;
+    h->used_nodes--;
+    if (h->engine == HASHMAP_LINEAR_PROBING) {
+        __relayout_nodes(h, i, 0);
+    }
+    __bloom_removed(h, 1);
+}
+
+static uint64_t __monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/* only nodes set with an expiry read the clock */
+static inline int __is_expired(const HashMap *h, const hashmap_node *node) {
+    if (node->expires == 0) {return 0;}
+    return ((const hashmap_ttl_node*)node)->expiry <= ((h->clock == NULL) ? __monotonic_ms() : h->clock());
+}
+
+static void __expire_node(HashMap *h, uint64_t i) {
+    if (h->evict != NULL) {
+        h->evict(h->nodes[i]->key, h->nodes[i]->value, h->evict_ctx);
+    }
+    __remove_node(h, i);
+}
+
+/*  gets of a cache set the bit side by side, so the store is atomic where the
+    compiler provides it; the sweep that clears it runs under the writer's guard */
+static inline void __mark_referenced(hashmap_node *node) {
+#if defined(__GNUC__)
+    __atomic_store_n(&node->referenced, 1, __ATOMIC_RELAXED);
+#else
+    node->referenced = 1;
+#endif
+}
+
+/*  CLOCK: sweep the buckets from the hand, giving referenced nodes a second
+    chance, and evict the first node that was not used since the last pass */
+static void __evict_node(HashMap *h) {
+    if (h->used_nodes == 0) {return;}
+    uint64_t i = (h->clock_hand < h->number_nodes) ? h->clock_hand : 0;
+    while (h->nodes[i] == NULL || h->nodes[i]->referenced != 0) {
+        if (h->nodes[i] != NULL) {
+            h->nodes[i]->referenced = 0;
+        }
+        i = (i + 1 == h->number_nodes) ? 0 : i + 1;
+    }
+    if (h->evict != NULL) {
+        h->evict(h->nodes[i]->key, h->nodes[i]->value, h->evict_ctx);
+    }
+    __remove_node(h, i);
+    h->clock_hand = i;  // a node from further along may have been moved here
+}
+
+/* a private copy of the key, or a reference to the shared copy in the pool; NULL if out of memory */
+static char* __acquire_key(HashMap *h, const char *key) {
+    if (h->intern_pool != NULL) {
+        return (char*)hashmap_intern(h->intern_pool, key);
+    }
+    int len = strlen(key);
+    char *k = (char*)__hm_calloc(h, len + 1, sizeof(char));
+    if (k == NULL) {return NULL;}
+    memcpy(k, key, len);
+    return k;
+}
+
+static void __release_key(HashMap *h, char *key) {
+    if (h->intern_pool != NULL) {
+        hashmap_intern_release(h->intern_pool, key);
+    } else {
+        __hm_free(h, key);
+    }
+}
+
+static int   __assign_node(HashMap *h, const char *key, void *value, short mallocd, uint64_t i, uint64_t hash, short expires) {
+    hashmap_node *node = (hashmap_node*)__hm_malloc(h, NODE_SIZE);
+    char *k = (node == NULL) ? NULL : __acquire_key(h, key);
+    if (k == NULL) {  // bucket i is left open
+        __hm_free(h, node);
+        return HASHMAP_FAILURE;
+    }
+    h->nodes[i] = node;
+    h->nodes[i]->expires = (expires != 0);
+    h->nodes[i]->key = k;
+    h->nodes[i]->value = value;
+    h->nodes[i]->hash = hash;
     h->nodes[i]->mallocd = mallocd;
+    h->nodes[i]->multi = 0;
+    h->nodes[i]->referenced = 0;
+    h->nodes[i]->value_size = 0;
+    h->tags[i] = __tag(hash);
     ++h->used_nodes;
+    __account_node(h, h->nodes[i], 1);
+    __bloom_add(h, hash);
+    return HASHMAP_SUCCESS;
+}
+
+/*  malloc's header and rounding for an allocation, modelled on glibc: an 8
+    byte header with chunks rounded up to 16 bytes and at least 32 */
+static inline uint64_t __alloc_overhead(uint64_t size) {
+    uint64_t chunk = (size + 8 + 15) & ~(uint64_t)15;
+    return ((chunk < 32) ? 32 : chunk) - size;
+}
+
+/* size of a value handed over by the user, if the allocator can tell */
+static uint64_t __value_size(const HashMap *h, void *value) {
+    #if defined (__GLIBC__)
+    if (h->allocator == NULL && value != NULL) {
+        return malloc_usable_size(value);
+    }
+    #endif
+    (void)h;
+    (void)value;
+    return 0;
+}
+
+static uint64_t __buckets_bytes(uint64_t num_els, short mapped) {
+    uint64_t bytes = num_els * sizeof(hashmap_node*);
+    return (mapped != 0) ? (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE : bytes;
+}
+
+/* add (sign 1) or take off (sign -1) the node, its key and its owned value */
+static void __account_node(HashMap *h, const hashmap_node *node, int sign) {
+    uint64_t size = NODE_SIZE;
+    uint64_t key_size = (h->intern_pool == NULL) ? strlen(node->key) + 1 : 0;
+    uint64_t overhead = __alloc_overhead(size) + ((key_size != 0) ? __alloc_overhead(key_size) : 0);
+    if (sign > 0) {
+        h->node_bytes += size;
+        h->key_bytes += key_size;
+        h->alloc_overhead += overhead;
+    } else {
+        h->node_bytes -= size;
+        h->key_bytes -= key_size;
+        h->alloc_overhead -= overhead;
+    }
+    __account_value(h, node, sign);
+}
+
+static inline void __account_value(HashMap *h, const hashmap_node *node, int sign) {
+    if (node->mallocd != 0 || node->value_size == 0) {return;}
+    if (sign > 0) {
+        h->value_bytes += node->value_size;
+        h->alloc_overhead += __alloc_overhead(node->value_size);
+    } else {
+        h->value_bytes -= node->value_size;
+        h->alloc_overhead -= __alloc_overhead(node->value_size);
+    }
+}
+
+/*  A copy of the node, its key and, if the hashmap owns it, its value; the
+    copy is counted by h. Returns NULL if anything could not be copied. */
+static hashmap_node* __clone_node(HashMap *h, const hashmap_node *node, hashmap_copy_function copy, void *ctx) {
+    hashmap_node *n = (hashmap_node*)__hm_malloc(h, NODE_SIZE);
+    if (n == NULL) {return NULL;}
+    memcpy(n, node, NODE_SIZE);  // the stored hash, flags and any expiry
+    if (node->mallocd == 0 && node->value != NULL) {
+        if (copy != NULL) {
+            n->value = copy(node->key, node->value, ctx);
+        } else if (node->value_size != 0) {
+            n->value = __hm_malloc(h, node->value_size);
+            if (n->value != NULL) {
+                memcpy(n->value, node->value, node->value_size);
+            }
+        } else {
+            n->value = NULL;  // the size is not known so it cannot be copied
+        }
+        if (n->value == NULL) {
+            __hm_free(h, n);
+            return NULL;
+        }
+    }
+    n->key = __acquire_key(h, node->key);
+    __account_node(h, n, 1);
+    return n;
+}
+
+/*  Copy every node of `from` into the same bucket of `to`; on failure the
+    buckets left are NULL so the copied nodes can be freed with the map */
+static int __clone_buckets(HashMap *dst, hashmap_node **to, hashmap_node * const *from, uint64_t num_els, hashmap_copy_function copy, void *ctx) {
+    for (uint64_t i = 0; i < num_els; ++i) {
+        if (from[i] == NULL) {
+            to[i] = NULL;
+            continue;
+        }
+        to[i] = __clone_node(dst, from[i], copy, ctx);
+        if (to[i] == NULL) {
+            memset(to + i, 0, (num_els - i) * sizeof(hashmap_node*));
+            return HASHMAP_FAILURE;
+        }
+        ++dst->used_nodes;
+    }
+    return HASHMAP_SUCCESS;
+}
+
+/* the stored hash can be reused when both maps hash the same way */
+static inline int __same_hash(const HashMap *a, const HashMap *b) {
+    return a->hash_function == b->hash_function && a->keyed_hash_function == b->keyed_hash_function &&
+           a->seed[0] == b->seed[0] && a->seed[1] == b->seed[1];
+}
+
+/*  Move a node taken out of src into dst, or combine it with the node of the
+    same key in dst; dst must already have room for it */
+/*  Move a node taken out of src into dst. On failure the node is left as it
+    was in src so that the caller can put it back. */
+static int __merge_node(HashMap *dst, HashMap *src, hashmap_node *node, int same_hash, hashmap_merge_function conflict, void *ctx) {
+    char *src_key = node->key;
+    uint64_t src_hash = node->hash;
+    if (same_hash == 0) {
+        node->hash = __hash_key(dst, node->key);
+    }
+    if (dst->intern_pool != src->intern_pool) {  // the key has to be owned by dst's pool
+        node->key = __acquire_key(dst, src_key);
+        if (node->key == NULL) {
+            node->key = src_key;
+            node->hash = src_hash;
+            return HASHMAP_FAILURE;
+        }
+    }
+    uint64_t i;
+    int e;
+    __get_node(dst, node->key, node->hash, &i, &e);
+    if (e == -1) {  // both cuckoo buckets are full; displace nodes or grow until it fits
+        while (__place_node(dst, node) == HASHMAP_FAILURE) {
+            if (__rebuild_nodes(dst, dst->number_nodes * 2) == HASHMAP_FAILURE) {
+                if (node->key != src_key) {
+                    __release_key(dst, node->key);
+                    node->key = src_key;
+                }
+                node->hash = src_hash;
+                return HASHMAP_FAILURE;
+            }
+        }
+    }
+    if (node->key != src_key) {
+        __release_key(src, src_key);
+    }
+    __account_node(dst, node, 1);  // counted by dst from here on, even if it is freed below
+    __bloom_add(dst, node->hash);
+    if (e == -1) {
+        ++dst->used_nodes;
+        return HASHMAP_SUCCESS;
+    }
+    if (dst->nodes[i] == NULL) {  // move the node over as is
+        __put_node(dst, i, node);
+        ++dst->used_nodes;
+        return HASHMAP_SUCCESS;
+    }
+    hashmap_node *d = dst->nodes[i];
+    void *v = (conflict == NULL) ? d->value : conflict(node->key, d->value, node->value, ctx);
+    __account_value(dst, d, -1);
+    if (v != d->value && d->mallocd == 0) {
+        __hm_free(dst, d->value);
+    }
+    if (v == node->value) {  // the source value and its ownership moves over
+        __account_value(dst, node, -1);
+        d->mallocd = node->mallocd;
+        d->value_size = node->value_size;
+        node->mallocd = -1;
+    } else if (v != d->value) {
+        d->value_size = 0;  // a new value from the conflict function; its size is not known
+    }
+    d->value = v;
+    __account_value(dst, d, 1);
+    __free_node(dst, node);  // the key belongs to dst now
+    return HASHMAP_SUCCESS;
+}
+
+/*  Move every node in partition `p` out of the thread maps into `part`. Only
+    buckets holding nodes of this partition are written, so the partitions
+    can be reduced concurrently. */
+static int __reduce_partition(HashMapAggregator *a, HashMap *part, uint64_t p, uint64_t num_parts, hashmap_merge_function combine, void *ctx) {
+    for (int t = 0; t < a->nthreads; ++t) {
+        HashMap *local = &a->locals[t].map;
+        int same_hash = __same_hash(part, local);
+        for (uint64_t k = 0; k < local->number_nodes; ++k) {
+            hashmap_node *node = local->nodes[k];
+            if (node == NULL || node->hash % num_parts != p) {
+                continue;
+            }
+            if (__get_fullness(part) >= __max_fullness(part) && __rebuild_nodes(part, part->number_nodes * 2) == HASHMAP_FAILURE) {
+                return HASHMAP_FAILURE;
+            }
+            local->nodes[k] = NULL;
+            if (__merge_node(part, local, node, same_hash, combine, ctx) == HASHMAP_FAILURE) {
+                local->nodes[k] = node;  // left where it was for __unreduce
+                return HASHMAP_FAILURE;
+            }
+        }
+    }
+    return HASHMAP_SUCCESS;
+}
+
+/*  After a failed reduce, move the nodes left in the partitions back into
+    the thread maps. Each thread map first closes the gaps that the moved
+    nodes left; its count was not lowered as they moved, so it can take nodes
+    back up to that count without growing and this cannot fail. */
+static void __unreduce(HashMapAggregator *a, HashMap *parts, uint64_t num_parts, const uint64_t *starts, hashmap_merge_function combine, void *ctx) {
+    uint64_t p = 0, k = 0;
+    for (int t = 0; t < a->nthreads; ++t) {
+        HashMap *local = &a->locals[t].map;
+        uint64_t room = local->used_nodes;
+        __compact_nodes(local, starts[t]);
+        local->used_nodes = 0;
+        local->node_bytes = local->key_bytes = local->value_bytes = local->alloc_overhead = 0;
+        for (uint64_t i = 0; i < local->number_nodes; ++i) {
+            if (local->nodes[i] != NULL) {
+                ++local->used_nodes;
+                __account_node(local, local->nodes[i], 1);
+            }
+        }
+        while (p < num_parts && local->used_nodes < room) {
+            if (k == parts[p].number_nodes) {
+                ++p;
+                k = 0;
+                continue;
+            }
+            hashmap_node *node = parts[p].nodes[k++];
+            if (node != NULL) {
+                parts[p].nodes[k - 1] = NULL;
+                --parts[p].used_nodes;
+                __merge_node(local, &parts[p], node, __same_hash(local, &parts[p]), combine, ctx);
+            }
+        }
+    }
+}
+
+static void __visit_range(const HashMap *h, uint64_t begin, uint64_t end, hashmap_visit_function fn, void *ctx) {
+    for (uint64_t i = begin; i < end; ++i) {
+        hashmap_node *node = __bucket(h, i);
+        if (node != NULL) {
+            fn(node->key, node->value, ctx);
+        }
+    }
+}
+
+/*******************************************************************************
+***        BLOOM FILTER
+*******************************************************************************/
+/*  the block comes from the top bits of the mixed hash and the four bits set
+    within it from the bottom 36, so they are independent of each other and of
+    the bucket (hash % number_nodes) and tag (top byte of the hash) */
+static inline uint64_t __bloom_mix(uint64_t hash) {
+    hash = (hash ^ (hash >> 31)) * 0x7fb5d329728ea185ULL;
+    return hash ^ (hash >> 27);
+}
+
+static inline void __bloom_set(uint64_t *bloom, uint64_t blocks, uint64_t hash) {
+    uint64_t m = __bloom_mix(hash);
+    uint64_t *block = bloom + ((m >> 36) % blocks) * BLOOM_BLOCK_WORDS;
+    for (int k = 0; k < 4; ++k, m >>= 9) {
+        block[(m & 511) >> 6] |= 1ULL << (m & 63);
+    }
+}
+
+static inline void __bloom_add(HashMap *h, uint64_t hash) {
+    if (h->bloom != NULL) {
+        __bloom_set(h->bloom, h->bloom_blocks, hash);
+    }
+    if (h->bloom_next != NULL) {
+        __bloom_set(h->bloom_next, h->bloom_next_blocks, hash);
+    }
+}
+
+/* 0 only if no stored key has this hash */
+static inline int __bloom_may_contain(const HashMap *h, uint64_t hash) {
+    if (h->bloom == NULL) {return 1;}
+    uint64_t m = __bloom_mix(hash);
+    const uint64_t *block = h->bloom + ((m >> 36) % h->bloom_blocks) * BLOOM_BLOCK_WORDS;
+    for (int k = 0; k < 4; ++k, m >>= 9) {
+        if ((block[(m & 511) >> 6] & (1ULL << (m & 63))) == 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* blocks for as many keys as the table can hold before it grows */
+static inline uint64_t __bloom_blocks(const HashMap *h) {
+    return (uint64_t)(h->number_nodes * __max_fullness(h)) / BLOOM_KEYS_PER_BLOCK + 1;
+}
+
+/* an uninitialized filter aligned within `alloc`, or NULL */
+static uint64_t* __bloom_alloc(HashMap *h, uint64_t blocks, void **alloc) {
+    *alloc = __hm_malloc(h, blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t) + 63);
+    if (*alloc == NULL) {return NULL;}
+    return (uint64_t*)(((uintptr_t)*alloc + 63) & ~(uintptr_t)63);  // one cache line per block
+}
+
+/*  (re)build the filter for as many keys as the table can hold before it
+    grows; on failure the filter is dropped, which only costs speed */
+static int __bloom_build(HashMap *h) {
+    uint64_t blocks = __bloom_blocks(h);
+    __bloom_drop_next(h);  // this one covers both arrays at the new size
+    if (blocks != h->bloom_blocks) {
+        hashmap_disable_bloom(h);
+        h->bloom = __bloom_alloc(h, blocks, &h->bloom_alloc);
+        if (h->bloom == NULL) {return HASHMAP_FAILURE;}
+        h->bloom_blocks = blocks;
+    }
+    __bloom_reset(h);
+    for (uint64_t i = 0; i < __num_buckets(h); ++i) {
+        hashmap_node *node = __bucket(h, i);
+        if (node != NULL) {
+            __bloom_add(h, node->hash);
+        }
+    }
+    return HASHMAP_SUCCESS;
+}
+
+static void __bloom_drop_next(HashMap *h) {
+    __hm_free(h, h->bloom_next_alloc);
+    h->bloom_next = NULL;
+    h->bloom_next_alloc = NULL;
+    h->bloom_next_blocks = 0;
+}
+
+static void __bloom_reset(HashMap *h) {
+    if (h->bloom != NULL) {
+        memset(h->bloom, 0, h->bloom_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t));
+    }
+    h->bloom_removed = 0;
+}
+
+/*  bits cannot be cleared, so removed keys leave them set; rebuild once they
+    outnumber the live keys and there were enough to pay for the pass */
+static void __bloom_removed(HashMap *h, uint64_t removed) {
+    if (h->bloom == NULL) {return;}
+    h->bloom_removed += removed;
+    if (h->bloom_removed > h->used_nodes && h->bloom_removed * 8 >= h->number_nodes) {
+        __bloom_build(h);
+    }
+}
+
+/*******************************************************************************
+***        INCREMENTAL RESIZE
+***
+***    Growing swaps in the larger bucket array right away and keeps the old
+***    one; writes then move RESIZE_STEP old buckets at a time, in order,
+***    starting from a bucket that was open so no cluster is split from its
+***    home. Until an old cluster is fully moved its remaining nodes are still
+***    found by probing the old array from the first bucket not yet moved.
+***    Any key an insert or remove touches is first moved to the new array so
+***    that everything past lookups only has to deal with one array; lookups
+***    probe both arrays and move nothing, so they stay read only.
+*******************************************************************************/
+/* buckets of the current and, while resizing, the old array, in that order */
+static inline uint64_t __num_buckets(const HashMap *h) {
+    return h->number_nodes + h->old_number_nodes;
+}
+
+static inline hashmap_node* __bucket(const HashMap *h, uint64_t i) {
+    return (i < h->number_nodes) ? h->nodes[i] : h->old_nodes[i - h->number_nodes];
+}
+
+static int __start_resize(HashMap *h, uint64_t num_els) {
+    short mapped;
+    hashmap_node **tmp = __alloc_buckets(h, num_els, &mapped);
+    if (tmp == NULL) {return HASHMAP_FAILURE;}
+    uint8_t *tmp_tags = (uint8_t*)__hm_calloc(h, num_els, sizeof(uint8_t));
+    if (tmp_tags == NULL) {
+        __free_buckets(h, tmp, num_els, mapped);
+        return HASHMAP_FAILURE;
+    }
+    h->migrate_start = __find_open_bucket(h);
+    h->migrated = 0;
+    h->old_nodes = h->nodes;
+    h->old_tags = h->tags;
+    h->old_number_nodes = h->number_nodes;
+    h->old_buckets_mapped = h->buckets_mapped;
+    h->nodes = tmp;
+    h->tags = tmp_tags;
+    h->number_nodes = num_els;
+    h->buckets_mapped = mapped;
+    if (h->bloom != NULL) {  // the old filter answers lookups until this one has every key
+        h->bloom_next_blocks = __bloom_blocks(h);
+        h->bloom_next = __bloom_alloc(h, h->bloom_next_blocks, &h->bloom_next_alloc);
+        if (h->bloom_next == NULL) {
+            hashmap_disable_bloom(h);  // only costs speed
+        } else {
+            memset(h->bloom_next, 0, h->bloom_next_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t));
+        }
+    }
+    return HASHMAP_SUCCESS;
+}
+
+/* move up to `budget` old buckets to the new array, freeing the old array once empty */
+static void __migrate(HashMap *h, uint64_t budget) {
+    for (; budget > 0 && h->old_nodes != NULL; --budget) {
+        uint64_t k = (h->migrate_start + h->migrated) % h->old_number_nodes;
+        if (h->old_nodes[k] != NULL) {
+            __place_node(h, h->old_nodes[k]);
+            if (h->bloom_next != NULL) {
+                __bloom_set(h->bloom_next, h->bloom_next_blocks, h->old_nodes[k]->hash);
+            }
+            h->old_nodes[k] = NULL;
+        }
+        if (++h->migrated == h->old_number_nodes) {
+            __free_buckets(h, h->old_nodes, h->old_number_nodes, h->old_buckets_mapped);
+            __hm_free(h, h->old_tags);
+            h->old_nodes = NULL;
+            h->old_tags = NULL;
+            h->old_number_nodes = 0;
+            h->migrated = 0;
+            if (h->bloom_next != NULL) {  // every key is in it now, so there is no pass over them
+                __hm_free(h, h->bloom_alloc);
+                h->bloom = h->bloom_next;
+                h->bloom_alloc = h->bloom_next_alloc;
+                h->bloom_blocks = h->bloom_next_blocks;
+                h->bloom_next = NULL;
+                h->bloom_next_alloc = NULL;
+                h->bloom_next_blocks = 0;
+            }
+        }
+    }
+}
+
+/*  Take a step of the resize and, if the key is still in the old array, move
+    everything up to it; afterwards the key is either in the new array or
+    not present at all */
+static void __settle_key(HashMap *h, const char *key, uint64_t hash) {
+    if (h->old_nodes == NULL) {return;}
+    __migrate(h, RESIZE_STEP);
+    if (h->old_nodes == NULL) {return;}
+    uint64_t n = h->old_number_nodes, i = __find_old(h, key, hash);
+    if (i != UINT64_MAX) {
+        __migrate(h, (i + n - h->migrate_start) % n - h->migrated + 1);
+    }
+}
+
+/* the old bucket still holding the key, or UINT64_MAX if it is not there */
+static uint64_t __find_old(const HashMap *h, const char *key, uint64_t hash) {
+    uint64_t n = h->old_number_nodes, i = hash % n;
+    if ((i + n - h->migrate_start) % n < h->migrated) {  // its home was moved; the rest of the cluster starts here
+        i = (h->migrate_start + h->migrated) % n;
+    }
+    size_t len = strlen(key);
+    uint8_t tag = __tag(hash);
+    for (; h->old_nodes[i] != NULL; i = (i + 1 == n) ? 0 : i + 1) {
+        hashmap_node *node = h->old_nodes[i];
+        if (h->old_tags[i] == tag && (node->key == key || (node->hash == hash && len == strlen(node->key) && strncmp(key, node->key, len) == 0))) {
+            return i;
+        }
+    }
+    return UINT64_MAX;
 }
 
 static inline float __get_fullness(const HashMap *h) {
     return h->used_nodes / (float) h->number_nodes;
 }
 
+static inline float __max_fullness(const HashMap *h) {
+    return (h->engine == HASHMAP_CUCKOO) ? CUCKOO_MAX_FULLNESS_PERCENT : MAX_FULLNESS_PERCENT;
+}
+
+/*  Each bucket has a tag, the top byte of its node's hash, kept in a parallel
+    array so that probes can skip most non-matching buckets without reading
+    the node. Tags of open buckets are stale and never looked at. */
+static inline uint8_t __tag(uint64_t hash) {
+    return (uint8_t)(hash >> 56);
+}
+
+static inline void __put_node(HashMap *h, uint64_t i, hashmap_node *node) {
+    h->nodes[i] = node;
+    h->tags[i] = __tag(node->hash);
+}
+
+static inline void __move_node(HashMap *h, uint64_t to, uint64_t from) {
+    h->nodes[to] = h->nodes[from];
+    h->tags[to] = h->tags[from];
+    h->nodes[from] = NULL;
+}
+
+/* the entry of a key is picked by its hash mixed with its group's displacement */
+static inline uint64_t __frozen_slot(uint64_t hash, uint32_t displacement, uint64_t n) {
+    uint64_t x = hash + (displacement + 1ULL) * 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return (x ^ (x >> 31)) % n;
+}
+
+/*  Try displacements until every node of the group lands on an open entry
+    that no other node of the group wants; the node pointer is parked in the
+    entry's key until the keys are copied. */
+static int __frozen_place(HashMapFrozen *frozen, hashmap_node **group, uint64_t size, uint64_t group_id, uint8_t *taken, uint64_t *slots) {
+    uint64_t j, k, n = frozen->number_keys;
+    for (j = 0; j < size; ++j) {
+        for (k = 0; k < j; ++k) {
+            if (group[j]->hash == group[k]->hash) {
+                return HASHMAP_FAILURE;  // no displacement can separate them
+            }
+        }
+    }
+    for (uint64_t d = 0; d <= UINT32_MAX; ++d) {
+        for (j = 0; j < size; ++j) {
+            slots[j] = __frozen_slot(group[j]->hash, (uint32_t)d, n);
+            if (taken[slots[j]] != 0) {
+                break;
+            }
+            for (k = 0; k < j && slots[k] != slots[j]; ++k) { }
+            if (k != j) {
+                break;
+            }
+        }
+        if (j == size) {
+            for (j = 0; j < size; ++j) {
+                taken[slots[j]] = 1;
+                frozen->entries[slots[j]].key = (const char*)group[j];
+            }
+            frozen->displacements[group_id] = (uint32_t)d;
+            return HASHMAP_SUCCESS;
+        }
+    }
+    return HASHMAP_FAILURE;
+}
+
+/*******************************************************************************
+***        CUCKOO ENGINE
+***
+***    The bucket array is split into buckets of CUCKOO_SLOTS nodes and every key
+***    lives in one of two buckets picked from its hash, so a lookup looks at no
+***    more than two buckets (found or not). Since removing a node does not
+***    break any probe sequence, nothing is re-laid out on removal.
+*******************************************************************************/
+static inline void __cuckoo_buckets(const HashMap *h, uint64_t hash, uint64_t *b1, uint64_t *b2) {
+    uint64_t num_buckets = h->number_nodes / CUCKOO_SLOTS;
+    uint64_t alt = (hash ^ (hash >> 29)) * 0xbf58476d1ce4e5b9ULL;  // different bits than the first bucket
+    *b1 = hash % num_buckets;
+    *b2 = (alt ^ (alt >> 32)) % num_buckets;
+    if (*b2 == *b1) {
+        *b2 = (*b1 + 1 == num_buckets) ? 0 : *b1 + 1;
+    }
+}
+
+/* same contract as __get_node: `i` is the node found, else the first open slot */
+static void* __cuckoo_get_node(HashMap *h, const char *key, uint64_t hash, uint64_t *i, int *error) {
+    uint64_t b[2];
+    int found_open = 0;
+    size_t len = strlen(key);
+    uint8_t tag = __tag(hash);
+    __cuckoo_buckets(h, hash, &b[0], &b[1]);
+    *error = 0;
+    for (int k = 0; k < 2; ++k) {
+        for (uint64_t j = b[k] * CUCKOO_SLOTS; j < (b[k] + 1) * CUCKOO_SLOTS; ++j) {
+            hashmap_node *node = h->nodes[j];
+            if (node == NULL) {
+                if (found_open == 0) {
+                    *i = j;
+                    found_open = 1;
+                }
+            } else if (h->tags[j] == tag && (node->key == key || (node->hash == hash && len == strlen(node->key) && strncmp(key, node->key, len) == 0))) {
+                *i = j;
+                return node->value;
+            }
+        }
+    }
+    if (found_open == 0) {
+        *i = b[0] * CUCKOO_SLOTS;
+        *error = -1;    // both buckets are full
+    }
+    return NULL;
+}
+
+/*  Both buckets of `hash` are full: breadth first search for a chain of nodes
+    that can each move to their other bucket, ending at a bucket with an open
+    slot, then shift the nodes along it. `i` is set to the slot freed in one of
+    the two buckets. Nothing is moved if no chain is found. */
+static int __cuckoo_make_room(HashMap *h, uint64_t hash, uint64_t *i) {
+    struct { uint64_t bucket; int parent, slot; } queue[CUCKOO_SEARCH_SIZE];
+    int head, tail = 2;
+    __cuckoo_buckets(h, hash, &queue[0].bucket, &queue[1].bucket);
+    queue[0].parent = queue[1].parent = -1;
+    queue[0].slot = queue[1].slot = 0;
+    for (head = 0; head < tail; ++head) {
+        uint64_t b = queue[head].bucket;
+        for (int s = 0; s < CUCKOO_SLOTS; ++s) {
+            uint64_t from = b * CUCKOO_SLOTS + s, b1, b2, alt, to;
+            __cuckoo_buckets(h, h->nodes[from]->hash, &b1, &b2);
+            alt = (b == b1) ? b2 : b1;
+            for (to = alt * CUCKOO_SLOTS; to < (alt + 1) * CUCKOO_SLOTS && h->nodes[to] != NULL; ++to) { }
+            if (to < (alt + 1) * CUCKOO_SLOTS) {
+                // found an open slot; shift every node on the path one step
+                __move_node(h, to, from);
+                for (int cur = head; queue[cur].parent != -1; cur = queue[cur].parent) {
+                    int p = queue[cur].parent;
+                    uint64_t src = queue[p].bucket * CUCKOO_SLOTS + queue[cur].slot;
+                    __move_node(h, from, src);
+                    from = src;
+                }
+                *i = from;
+                return HASHMAP_SUCCESS;
+            }
+            if (tail < CUCKOO_SEARCH_SIZE) {
+                queue[tail].bucket = alt;
+                queue[tail].parent = head;
+                queue[tail].slot = s;
+                ++tail;
+            }
+        }
+    }
+    return HASHMAP_FAILURE;
+}
+
 static void __calc_stats(const HashMap *h, uint64_t *worst_case, uint64_t *max_big_o, float *avg_big_o, float *avg_used_big_o, unsigned int *hash, unsigned int *idx) {
     uint64_t sum = 0, max = 0, wc = 0, sum_used = 0;
     unsigned int hash_col = 0, idx_col = 0;
@@ -301,18 +2675,31 @@ static void __calc_stats(const HashMap *h, uint64_t *worst_case, uint64_t *max_b
         uint64_t j = 0, cur = 0;
         uint64_t *hashes = (uint64_t*)calloc(h->used_nodes, sizeof(uint64_t));
         uint64_t *idxs = (uint64_t*)calloc(h->used_nodes, sizeof(uint64_t));
-        for (uint64_t i = 0; i < h->number_nodes; ++i) {
-            if (h->nodes[i] != NULL) {
+        for (uint64_t i = 0; i < __num_buckets(h); ++i) {
+            hashmap_node *node = __bucket(h, i);
+            // while resizing the old array follows the current one; probes stay within an array
+            const uint64_t n = (i < h->number_nodes) ? h->number_nodes : h->old_number_nodes;
+            const uint64_t k = (i < h->number_nodes) ? i : i - h->number_nodes;
+            if (k == 0) {
+                if (wc < cur) { wc = cur; }
+                cur = 0;
+            }
+            if (node != NULL) {
                 ++cur;
-                uint64_t _idx = h->nodes[i]->hash % h->number_nodes;
-                uint64_t O = __calc_big_o(h->number_nodes, i, _idx);
+                uint64_t _idx = node->hash % n;
+                uint64_t O = __calc_big_o(n, k, _idx);
+                if (h->engine == HASHMAP_CUCKOO) {  // buckets looked at, not slots
+                    uint64_t b1, b2;
+                    __cuckoo_buckets(h, node->hash, &b1, &b2);
+                    O = (i / CUCKOO_SLOTS == b1) ? 1 : 2;
+                }
                 sum_used += O;
                 sum += O;
                 if (O > max) {
                     max = O;
                 }
-                hashes[j] = h->nodes[i]->hash;
-                idxs[j] = _idx;
+                hashes[j] = node->hash;
+                idxs[j] = node->hash % h->number_nodes;  // where it is once any resize is done
                 ++j;
             } else {
                 sum += 1;
@@ -340,7 +2727,7 @@ static void __calc_stats(const HashMap *h, uint64_t *worst_case, uint64_t *max_b
 
     *worst_case = wc;
     *max_big_o = max;
-    *avg_big_o = sum / ((float)h->number_nodes);
+    *avg_big_o = sum / ((float)__num_buckets(h));
     if (h->used_nodes != 0) {
         *avg_used_big_o = sum_used / ((float)h->used_nodes);
     } else {
@@ -355,6 +2742,272 @@ static inline int __calc_big_o(uint64_t num_nodes, uint64_t i, uint64_t idx) {
     return (i < idx) ? i + num_nodes - idx + 1 : 1 + i - idx;
 }
 
+/* buffer `data`, writing the buffer out to the file descriptor whenever it fills */
+static int __stream_write(int fd, unsigned char *buf, size_t *used, const void *data, size_t len) {
+    if (*used + len > STREAM_BUFFER_SIZE) {
+        if (__stream_flush(fd, buf, *used) == HASHMAP_FAILURE) {return HASHMAP_FAILURE;}
+        *used = 0;
+        if (len > STREAM_BUFFER_SIZE) {  // too big to buffer
+            return __stream_flush(fd, (const unsigned char*)data, len);
+        }
+    }
+    memcpy(buf + *used, data, len);
+    *used += len;
+    return HASHMAP_SUCCESS;
+}
+
+static int __stream_flush(int fd, const unsigned char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            return HASHMAP_FAILURE;
+        }
+        buf += n;
+        len -= n;
+    }
+    return HASHMAP_SUCCESS;
+}
+
+/* copy `len` bytes out of the buffer, refilling it from the file descriptor as needed */
+static int __stream_read(int fd, unsigned char *buf, size_t *pos, size_t *filled, void *data, size_t len) {
+    unsigned char *out = (unsigned char*)data;
+    while (len > 0) {
+        if (*pos == *filled) {
+            ssize_t n = read(fd, buf, STREAM_BUFFER_SIZE);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            } else if (n <= 0) {  // error or truncated stream
+                return HASHMAP_FAILURE;
+            }
+            *pos = 0;
+            *filled = n;
+        }
+        size_t c = (*filled - *pos < len) ? *filled - *pos : len;
+        memcpy(out, buf + *pos, c);
+        *pos += c;
+        out += c;
+        len -= c;
+    }
+    return HASHMAP_SUCCESS;
+}
+
+static int __stream_grow(unsigned char **buf, size_t *size, size_t len) {
+    if (len <= *size) {return HASHMAP_SUCCESS;}
+    unsigned char *tmp = (unsigned char*)realloc(*buf, len);
+    if (tmp == NULL) {return HASHMAP_FAILURE;}
+    *buf = tmp;
+    *size = len;
+    return HASHMAP_SUCCESS;
+}
+
+/*  read `len` bytes into `*data` and NUL terminate them, growing it as the
+    bytes arrive rather than up front so that a corrupt length cannot allocate
+    much more than the stream holds */
+static int __stream_read_grow(int fd, unsigned char *buf, size_t *pos, size_t *filled, unsigned char **data, size_t *size, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        if (got + 1 == *size && __stream_grow(data, size, *size * 2) == HASHMAP_FAILURE) {
+            return HASHMAP_FAILURE;
+        }
+        size_t c = (len - got < *size - 1 - got) ? len - got : *size - 1 - got;
+        if (__stream_read(fd, buf, pos, filled, *data + got, c) == HASHMAP_FAILURE) {
+            return HASHMAP_FAILURE;
+        }
+        got += c;
+    }
+    (*data)[len] = '\0';
+    return HASHMAP_SUCCESS;
+}
+
+static void __put_u32(unsigned char *out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) {
+        out[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static void __put_u64(unsigned char *out, uint64_t v) {
+    for (int i = 0; i < 8; ++i) {
+        out[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static uint32_t __get_u32(const unsigned char *in) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) {
+        v |= ((uint32_t)in[i]) << (8 * i);
+    }
+    return v;
+}
+
+static uint64_t __get_u64(const unsigned char *in) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) {
+        v |= ((uint64_t)in[i]) << (8 * i);
+    }
+    return v;
+}
+
+static inline int64_t __compact_slot(const HashMapCompact *c, uint64_t i) {
+    switch (c->index_width) {
+        case 1: return ((const int8_t*)c->index)[i];
+        case 2: return ((const int16_t*)c->index)[i];
+        case 4: return ((const int32_t*)c->index)[i];
+        default: return ((const int64_t*)c->index)[i];
+    }
+}
+
+static inline void __compact_set_slot(HashMapCompact *c, uint64_t i, int64_t pos) {
+    switch (c->index_width) {
+        case 1: ((int8_t*)c->index)[i] = (int8_t)pos; break;
+        case 2: ((int16_t*)c->index)[i] = (int16_t)pos; break;
+        case 4: ((int32_t*)c->index)[i] = (int32_t)pos; break;
+        default: ((int64_t*)c->index)[i] = pos; break;
+    }
+}
+
+/*  Linear probe of the index; returns the key's entry, or COMPACT_EMPTY with
+    `slot` set to the empty slot that ended the probe. The entries never fill
+    more than half the slots, so there always is one. */
+static int64_t __compact_find(const HashMapCompact *c, const char *key, uint64_t hash, uint64_t *slot) {
+    uint64_t i = hash % c->number_slots;
+    for (;;) {
+        int64_t pos = __compact_slot(c, i);
+        if (pos == COMPACT_EMPTY) {
+            *slot = i;
+            return COMPACT_EMPTY;
+        }
+        if (pos >= 0 && c->entries[pos].hash == hash && strcmp(c->entries[pos].key, key) == 0) {
+            *slot = i;
+            return pos;
+        }
+        i = (i + 1 == c->number_slots) ? 0 : i + 1;
+    }
+}
+
+/*  Drop the removed entries, keeping the order of the rest, and rebuild the
+    index with `num_slots` slots of the narrowest width that can hold every
+    entry position */
+static int __compact_resize(HashMapCompact *c, uint64_t num_slots) {
+    uint64_t j, k, capacity = num_slots / 2;
+    short width = (capacity <= INT8_MAX) ? 1 : (capacity <= INT16_MAX) ? 2 : (capacity <= INT32_MAX) ? 4 : 8;
+    void *index = malloc(num_slots * width);
+    if (index == NULL) {return HASHMAP_FAILURE;}
+    // the slots never shrink, so neither does the entries array
+    hashmap_compact_entry *entries = (hashmap_compact_entry*)realloc(c->entries, capacity * sizeof(hashmap_compact_entry));
+    if (entries == NULL) {
+        free(index);
+        return HASHMAP_FAILURE;
+    }
+    for (j = 0, k = 0; j < c->number_entries; ++j) {
+        if (entries[j].key != NULL) {
+            entries[k++] = entries[j];
+        }
+    }
+    free(c->index);
+    memset(index, 0xff, num_slots * width);  // COMPACT_EMPTY in every width
+    c->index = index;
+    c->entries = entries;
+    c->number_slots = num_slots;
+    c->number_entries = k;
+    c->index_width = width;
+    for (j = 0; j < k; ++j) {
+        uint64_t i = entries[j].hash % num_slots;
+        while (__compact_slot(c, i) != COMPACT_EMPTY) {
+            i = (i + 1 == num_slots) ? 0 : i + 1;
+        }
+        __compact_set_slot(c, i, j);
+    }
+    return HASHMAP_SUCCESS;
+}
+
+/* stable LSD radix sort of the indices in `order` by their bucket */
+static void __sort_by_bucket(uint64_t *order, uint64_t *tmp, const uint64_t *buckets, uint64_t n, uint64_t num_buckets) {
+    uint64_t i, count[256];
+    for (int shift = 0; shift < 64 && (num_buckets - 1) >> shift != 0; shift += 8) {
+        memset(count, 0, sizeof(count));
+        for (i = 0; i < n; ++i) {
+            ++count[(buckets[order[i]] >> shift) & 0xff];
+        }
+        uint64_t sum = 0;
+        for (i = 0; i < 256; ++i) {
+            uint64_t c = count[i];
+            count[i] = sum;
+            sum += c;
+        }
+        for (i = 0; i < n; ++i) {
+            tmp[count[(buckets[order[i]] >> shift) & 0xff]++] = order[i];
+        }
+        memcpy(order, tmp, n * sizeof(uint64_t));
+    }
+}
+
+/* LSD radix sort, a byte at a time, skipping bytes that are the same for all */
+static void __sort_nodes_by_hash(hashmap_node **nodes, hashmap_node **tmp, uint64_t n) {
+    uint64_t i, count[256];
+    for (int shift = 0; shift < 64; shift += 8) {
+        memset(count, 0, sizeof(count));
+        for (i = 0; i < n; ++i) {
+            ++count[(nodes[i]->hash >> shift) & 0xff];
+        }
+        if (n == 0 || count[(nodes[0]->hash >> shift) & 0xff] == n) {
+            continue;
+        }
+        uint64_t sum = 0;
+        for (i = 0; i < 256; ++i) {
+            uint64_t c = count[i];
+            count[i] = sum;
+            sum += c;
+        }
+        for (i = 0; i < n; ++i) {
+            tmp[count[(nodes[i]->hash >> shift) & 0xff]++] = nodes[i];
+        }
+        memcpy(nodes, tmp, n * sizeof(hashmap_node*));
+    }
+}
+
+/*  MSD radix sort on the bytes of the keys (the same order as strcmp); small
+    partitions are finished with an insertion sort */
+static void __sort_nodes_by_key(hashmap_node **nodes, hashmap_node **tmp, uint64_t n, size_t depth) {
+    uint64_t i, count[257];
+    while (n >= 32) {
+        memset(count, 0, sizeof(count));
+        for (i = 0; i < n; ++i) {
+            ++count[(unsigned char)nodes[i]->key[depth] + 1];
+        }
+        if (count[(unsigned char)nodes[0]->key[depth] + 1] == n) {
+            // all share this byte; look at the next one without recursing
+            if (nodes[0]->key[depth] == '\0') {return;}
+            ++depth;
+            continue;
+        }
+        for (i = 1; i < 257; ++i) {
+            count[i] += count[i - 1];
+        }
+        for (i = 0; i < n; ++i) {
+            tmp[count[(unsigned char)nodes[i]->key[depth]]++] = nodes[i];
+        }
+        memcpy(nodes, tmp, n * sizeof(hashmap_node*));
+        // count[c] is now the end of bucket c; bucket 0 holds the finished keys
+        for (i = 1; i < 256; ++i) {
+            if (count[i] - count[i - 1] > 1) {
+                __sort_nodes_by_key(nodes + count[i - 1], tmp, count[i] - count[i - 1], depth + 1);
+            }
+        }
+        return;
+    }
+    for (i = 1; i < n; ++i) {
+        hashmap_node *node = nodes[i];
+        uint64_t j = i;
+        while (j > 0 && strcmp(nodes[j - 1]->key + depth, node->key + depth) > 0) {
+            nodes[j] = nodes[j - 1];
+            --j;
+        }
+        nodes[j] = node;
+    }
+}
+
 static void __merge_sort(uint64_t *arr, uint64_t length) {
     if (length < 2) {
         return;
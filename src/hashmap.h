@@ -19,6 +19,7 @@ extern "C" {
 #endif
 
 #include <inttypes.h>       /* PRIu64 */
+#include <stddef.h>         /* size_t */
 
 #ifdef __APPLE__
 #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
@@ -37,29 +38,156 @@ extern "C" {
 #define HASHMAP_FAILURE -1
 #define HASHMAP_SUCCESS 0
 
+/* orders for hashmap_keys_sorted */
+#define HASHMAP_SORT_KEYS 0     /* lexicographic, the same as strcmp */
+#define HASHMAP_SORT_HASH 1
+
+/* table engines */
+#define HASHMAP_LINEAR_PROBING 0
+#define HASHMAP_CUCKOO 1
+
+/* flags for hashmap_init_with_flags */
+#define HASHMAP_HUGE_PAGES 1        /* back large bucket arrays with huge pages */
+#define HASHMAP_NUMA_INTERLEAVE 2   /* interleave large bucket arrays over the NUMA nodes */
+
+/* probe length on insert that triggers a re-seed of maps using a keyed hash */
+#ifndef HASHMAP_MAX_PROBE_LENGTH
+#define HASHMAP_MAX_PROBE_LENGTH 64
+#endif
+
 #define hashmap_get_version()    (HASHMAP_VERSION)
 #define hashmap_number_keys(h)   (h.used_nodes)
 
 
 typedef uint64_t (*hashmap_hash_function) (const char *key);
+typedef uint64_t (*hashmap_keyed_hash_function) (const char *key, const uint64_t seed[2]);
+typedef int (*hashmap_predicate_function) (const char *key, void *value, void *ctx);
+typedef void (*hashmap_visit_function) (const char *key, void *value, void *ctx);
+typedef size_t (*hashmap_value_encoder) (const char *key, const void *value, void *buf, size_t buf_len, void *ctx);
+typedef void* (*hashmap_value_decoder) (const char *key, const void *buf, size_t len, void *ctx);
+typedef void* (*hashmap_merge_function) (const char *key, void *dst_value, void *src_value, void *ctx);
+typedef uint64_t (*hashmap_clock_function) (void);
+typedef void* (*hashmap_copy_function) (const char *key, const void *value, void *ctx);
 
 /*******************************************************************************
 ***    Data structures
 *******************************************************************************/
+/*  Allocation functions used for the nodes, keys, owned values and bucket
+    array of a hashmap; `ctx` is passed through to each function */
+typedef struct hashmap_allocator {
+    void* (*malloc_fn) (size_t size, void *ctx);
+    void* (*calloc_fn) (size_t num, size_t size, void *ctx);
+    void* (*realloc_fn) (void *ptr, size_t size, void *ctx);
+    void  (*free_fn) (void *ptr, void *ctx);
+    void *ctx;
+} hashmap_allocator;
+
 typedef struct hashmap_node {
     char *key;
     void *value;
     uint64_t hash;
-    short mallocd; /* signals if need to deallocate the memory */
+    signed char mallocd;      /* signals if need to deallocate the memory */
+    unsigned char multi;      /* signals the value is a block of hashmap_multi_add values */
+    unsigned char referenced; /* CLOCK bit; set when a cache map's key is used */
+    unsigned char expires;    /* signals the node has an expiry time */
+    uint32_t value_size;      /* bytes of an owned value, 0 if not known */
 } hashmap_node;
 
 typedef struct hashmap {
     hashmap_node **nodes;
+    uint8_t *tags;               /* top byte of the hash of each bucket's node */
     uint64_t number_nodes;
     uint64_t used_nodes;
     hashmap_hash_function hash_function;
+    hashmap_keyed_hash_function keyed_hash_function; /* used instead of hash_function when set */
+    uint64_t seed[2];
+    struct hashmap *intern_pool; /* shared key storage; NULL if keys are private copies */
+    const hashmap_allocator *allocator; /* NULL to use malloc, calloc, realloc and free */
+    int alloc_flags;             /* HASHMAP_HUGE_PAGES, HASHMAP_NUMA_INTERLEAVE */
+    short buckets_mapped;        /* signals if the bucket array was mmap'd */
+    short engine;                /* HASHMAP_LINEAR_PROBING or HASHMAP_CUCKOO */
+    uint64_t capacity;           /* maximum number of keys of a cache; 0 if unbounded */
+    uint64_t clock_hand;         /* next bucket the eviction sweep looks at */
+    hashmap_visit_function evict; /* called on each evicted or expired key and value */
+    void *evict_ctx;
+    hashmap_clock_function clock; /* the time expiries are compared to; NULL for monotonic ms */
+    uint64_t expire_cursor;      /* next bucket hashmap_expire_step looks at */
+    short incremental;           /* signals that growing moves the nodes a few at a time */
+    short old_buckets_mapped;
+    hashmap_node **old_nodes;    /* the bucket array being moved out of; NULL unless resizing */
+    uint8_t *old_tags;
+    uint64_t old_number_nodes;
+    uint64_t migrate_start;      /* the old bucket the move started from */
+    uint64_t migrated;           /* old buckets moved so far */
+    uint64_t node_bytes;         /* running totals reported by hashmap_memory_usage */
+    uint64_t key_bytes;
+    uint64_t value_bytes;
+    uint64_t alloc_overhead;
+    uint64_t *bloom;             /* blocked Bloom filter of the stored hashes; NULL unless enabled */
+    void *bloom_alloc;           /* the allocation bloom is aligned within */
+    uint64_t bloom_blocks;       /* 64 byte blocks */
+    uint64_t bloom_removed;      /* keys removed since the filter was built; their bits are still set */
+    uint64_t *bloom_next;        /* filter for the new array, filled as an incremental resize moves keys */
+    void *bloom_next_alloc;
+    uint64_t bloom_next_blocks;
 } HashMap;
 
+/* bytes used by a hashmap; see hashmap_memory_usage */
+typedef struct hashmap_memory {
+    uint64_t buckets;    /* the bucket, tag and Bloom filter arrays, including any being resized out of */
+    uint64_t nodes;
+    uint64_t keys;       /* private key copies; interned keys are counted by their pool */
+    uint64_t values;     /* owned values of known size */
+    uint64_t overhead;   /* estimated allocator headers and rounding */
+    uint64_t total;
+} hashmap_memory;
+
+/*  One hashmap per thread so that each thread can aggregate into its own
+    map without locks; see hashmap_aggregator_init */
+typedef struct hashmap_aggregator {
+    struct hashmap_local *locals;  /* one padded hashmap per thread */
+    int nthreads;
+} HashMapAggregator;
+
+typedef struct hashmap_frozen_entry {
+    const char *key;             /* points into the key arena */
+    void *value;
+    uint64_t hash;
+    short mallocd; /* signals if need to deallocate the memory */
+} hashmap_frozen_entry;
+
+/*  Read-only map built by hashmap_freeze; `displacements` picks the single
+    entry a key can be in so there is exactly one probe per lookup */
+typedef struct hashmap_frozen {
+    hashmap_frozen_entry *entries; /* one per key, no empty slots */
+    uint32_t *displacements;       /* one per group of keys sharing hash % number_groups */
+    char *keys;                    /* every key, NULL terminated, back to back */
+    uint64_t number_keys;
+    uint64_t number_groups;
+    hashmap_hash_function hash_function;
+    hashmap_keyed_hash_function keyed_hash_function;
+    uint64_t seed[2];
+    const hashmap_allocator *allocator;
+} HashMapFrozen;
+
+typedef struct hashmap_compact_entry {
+    char *key;                   /* NULL once the key is removed */
+    void *value;
+    uint64_t hash;
+} hashmap_compact_entry;
+
+/*  Insertion ordered map; a sparse index of 1, 2, 4 or 8 byte entry positions,
+    the narrowest that fits, points into a dense array of the entries */
+typedef struct hashmap_compact {
+    void *index;                     /* -1 for an empty slot and -2 for a removed entry */
+    hashmap_compact_entry *entries;  /* in insertion order, including removed entries */
+    uint64_t number_slots;
+    uint64_t number_entries;         /* entries used, including removed entries */
+    uint64_t used_nodes;
+    hashmap_hash_function hash_function;
+    short index_width;               /* bytes per index slot */
+} HashMapCompact;
+
 
 /* initialize the hashmap using the provided hashing function */
 int hashmap_init_alt(HashMap *h,  uint64_t num_els, hashmap_hash_function hash_function);
@@ -67,6 +195,88 @@ static __inline__ int hashmap_init(HashMap *h) {
     return hashmap_init_alt(h, 1024, NULL);
 }
 
+/*  initialize the hashmap as a cache of at most `capacity` keys. Adding a key
+    to a full cache evicts one that was not used recently (CLOCK: `get` and
+    updates mark a key as used and the eviction sweep gives marked keys a
+    second chance). `evict(key, value, ctx)` is called, if not NULL, before a
+    key is evicted; values the hashmap owns are free'd after it returns. Gets
+    mark keys with a relaxed atomic store on GCC and Clang, so they can run
+    side by side without guards; other compilers need them. */
+int hashmap_init_cache(HashMap *h, uint64_t capacity, hashmap_hash_function hash_function, hashmap_visit_function evict, void *ctx);
+
+/*  initialize the hashmap to grow incrementally: instead of moving every node
+    at once on the insert that crosses the max fullness, the larger bucket
+    array is swapped in right away and each later insert and remove moves a
+    few buckets of the old array over, so no single insert pays for the whole
+    resize. Lookups check both arrays until it is done and move nothing, so
+    they can still run side by side without guards. */
+int hashmap_init_incremental(HashMap *h, uint64_t num_els, hashmap_hash_function hash_function);
+
+/*  Moves up to `budget` buckets of an in-progress incremental resize, so that
+    idle time can be used to finish it early. Returns the number of old
+    buckets left to move; 0 when no resize is in progress. */
+uint64_t hashmap_resize_step(HashMap *h, uint64_t budget);
+
+/*  Keep a blocked Bloom filter of the keys next to the table so that most
+    gets and removes of missing keys read a single cache line instead of
+    probing the cluster. It is built from the current keys, rebuilt when the
+    table is rebuilt or once the removed keys outnumber the live ones, and
+    costs about 16 bits per key the table can hold. While an incremental map
+    grows, a second filter sized for the new table is filled as the keys move
+    over and replaces the first when the resize finishes, so growing does not
+    pause to rebuild it. Returns HASHMAP_FAILURE if it could not be allocated. */
+int hashmap_enable_bloom(HashMap *h);
+
+/* Free the Bloom filter; lookups probe the table directly again */
+void hashmap_disable_bloom(HashMap *h);
+
+/*  initialize the hashmap to use bucketized cuckoo hashing instead of linear
+    probing: the bucket array is split into buckets of 8 nodes (a cache line
+    of pointers) and each key lives in one of two buckets, so every lookup,
+    found or not, looks at no more than two buckets. The table is allowed to
+    be 90% full before it grows; inserts may move other nodes to their
+    alternate bucket. All other functions work the same on either engine. */
+int hashmap_init_cuckoo(HashMap *h, uint64_t num_els, hashmap_hash_function hash_function);
+
+/*  initialize the hashmap with bucket array allocation flags. Bucket arrays of
+    2 MB or more are mmap'd: with HASHMAP_HUGE_PAGES they use explicit huge
+    pages (MAP_HUGETLB) if any are reserved, otherwise transparent huge pages
+    (MADV_HUGEPAGE); with HASHMAP_NUMA_INTERLEAVE their pages are interleaved
+    over the online NUMA nodes (Linux). Anything that is not available falls
+    back to the normal allocation. */
+int hashmap_init_with_flags(HashMap *h, uint64_t num_els, hashmap_hash_function hash_function, int flags);
+
+/*  initialize the hashmap to allocate its nodes, keys, owned values (from
+    the utility inserts), and bucket array with `allocator`, which must outlive
+    the hashmap. Values passed to `hashmap_set_alt` are released with its
+    `free_fn`, so they should come from the same allocator. */
+int hashmap_init_with_allocator(HashMap *h, uint64_t num_els, hashmap_hash_function hash_function, const hashmap_allocator *allocator);
+
+/*  initialize the hashmap using a keyed hash function with a per-map seed; if
+    `hash_function` is NULL SipHash-2-4 is used and if `seed` is NULL a random
+    seed is generated. If an insert has to probe more than
+    HASHMAP_MAX_PROBE_LENGTH buckets the map picks a new random seed and
+    re-hashes every key, which breaks up clusters forced by chosen keys. */
+int hashmap_init_seeded(HashMap *h, uint64_t num_els, hashmap_keyed_hash_function hash_function, const uint64_t seed[2]);
+
+/* SipHash-2-4 of the key; the default keyed hash function */
+uint64_t hashmap_siphash(const char *key, const uint64_t seed[2]);
+
+/*  initialize the hashmap to store its keys in a shared interning `pool`
+    instead of making a private copy of each key. The pool is a hashmap
+    initialized by the caller (e.g. `hashmap_init`) that only holds the keys and
+    their reference counts; it can be shared by any number of hashmaps and must
+    be destroyed after all of them. Lookups using a key returned by
+    `hashmap_intern` compare by pointer. */
+int hashmap_init_interned(HashMap *h, uint64_t num_els, hashmap_hash_function hash_function, HashMap *pool);
+
+/*  Returns the pooled copy of the key, adding it to the pool if needed, and
+    takes a reference to it; release it with `hashmap_intern_release` */
+const char* hashmap_intern(HashMap *pool, const char *key);
+
+/* Drops a reference to the key; it is free'd once no hashmap references it */
+void hashmap_intern_release(HashMap *pool, const char *key);
+
 /*  frees all memory allocated by the hashmap library
     NOTE: If the value is malloc'd memory, it is up to the user to free it */
 void hashmap_destroy(HashMap *h);
@@ -85,9 +295,67 @@ void* hashmap_set(HashMap *h, const char *key, void *value);
     destruction. */
 void* hashmap_set_alt(HashMap *h, const char *key, void * value);
 
+/*  Adds or updates the key (as with `hashmap_set`) to expire at `expiry`, a
+    time from the hashmap's clock (milliseconds of CLOCK_MONOTONIC unless set
+    with `hashmap_set_expiry`). Once expired the key is treated as missing and
+    reclaimed by the next insert or remove of it, or by `hashmap_expire_step`;
+    until then it is still counted and iterated over. `hashmap_get` only
+    reports it as missing, so gets stay read only.
+    Setting the key again with `hashmap_set` or `hashmap_set_alt` removes the
+    expiry. */
+void* hashmap_set_ttl(HashMap *h, const char *key, void *value, uint64_t expiry);
+
+/*  Sets the clock expiries are compared to (NULL for the default) and the
+    function called with each key and value as it is reclaimed, before the
+    values the hashmap owns are free'd. This is the same function called on
+    evictions from a cache. */
+void hashmap_set_expiry(HashMap *h, hashmap_clock_function clock, hashmap_visit_function expired, void *ctx);
+
+/*  Reclaims expired keys looking at up to `budget` buckets (a bucket is
+    looked at again after its key is removed), picking up where the previous
+    call stopped, so that the cost of expiring keys can be spread out.
+    Returns the number of keys removed. */
+uint64_t hashmap_expire_step(HashMap *h, uint64_t budget);
+
 /* Returns the pointer to the value of the found key, or NULL if not found */
 void* hashmap_get(HashMap *h, const char *key);
 
+/*  Returns a pointer to the value slot of the key after a single hash and
+    probe. If the key is not present it is added with a NULL value and
+    `inserted` (if not NULL) is set to 1, otherwise it is set to 0. The slot
+    can be read and written in place and stays valid until the key is removed.
+    Values added this way are not free'd by the hashmap. */
+void** hashmap_get_or_insert(HashMap *h, const char *key, int *inserted);
+
+/*  Adds `delta` to the int value of the key in place, adding the key with the
+    value `delta` if it is not present. The value must have been added by
+    `hashmap_set_int` or `hashmap_increment`. Returns the pointer to the value,
+    which stays valid until the key is removed so it can also be updated
+    atomically by the caller, or NULL if memory could not be allocated (a new
+    key is then not added). */
+int* hashmap_increment(HashMap *h, const char *key, const int delta);
+
+/*  Multimap keys hold any number of values, stored back to back in a single
+    block that the hashmap owns and grows as needed (the values themselves
+    are not free'd). A key added with `hashmap_multi_add` must only be used
+    with the hashmap_multi functions and the functions that remove keys.
+    Returns HASHMAP_FAILURE if the key holds a single value from any other
+    set function (`hashmap_set`, `hashmap_set_int`, `hashmap_set_string`,
+    ...) or memory could not be allocated. */
+int hashmap_multi_add(HashMap *h, const char *key, void *value);
+
+/*  Returns the values of the key in the order they were added and sets
+    `count`; NULL, and a count of 0, if the key is not present or was not
+    added by `hashmap_multi_add`. The array is
+    valid until the key is next added to or removed. */
+void** hashmap_multi_get(HashMap *h, const char *key, uint64_t *count);
+
+/*  Removes the first occurrence of `value` from the key, keeping the order
+    of the rest; the key is removed with its last value. Returns
+    HASHMAP_FAILURE if the key or value is not present, or the key was not
+    added by `hashmap_multi_add`. */
+int hashmap_multi_remove_value(HashMap *h, const char *key, const void *value);
+
 /*  Removes a key from the hashmap. NULL will be returned if it is not present.
     If it is designated to be cleaned up, the memory will be free'd and NULL
     returned. Otherwise, the pointer to the value will be returned.
@@ -95,10 +363,159 @@ void* hashmap_get(HashMap *h, const char *key);
     TODO: Add a int flag to signal if NULL is b/c it was freed or not present */
 void* hashmap_remove(HashMap *h, const char *key);
 
+/*  Sets `n` keys at once, the same as calling hashmap_set(h, keys[i],
+    values[i]) for each (a key repeated in the batch keeps its last value). The
+    table is grown once for the whole batch, the keys are hashed up front (in
+    parallel with OpenMP, so the hash function must be thread safe) and then
+    inserted in bucket order. If `replaced` is not NULL, `replaced[i]` is set
+    to the value that keys[i] replaced, or NULL if it was added. Returns the
+    number of keys set; fewer than `n` only if memory ran out. */
+uint64_t hashmap_set_many(HashMap *h, const char * const *keys, void * const *values, uint64_t n, void **replaced);
+
+/*  Removes `n` keys at once; victims are found first and then the bucket
+    array is compacted in a single pass instead of re-laying out the cluster
+    after each key. If `values` is not NULL, `values[i]` is set to what
+    `hashmap_remove(h, keys[i])` would have returned. Returns the number of
+    keys removed. */
+uint64_t hashmap_remove_many(HashMap *h, const char * const *keys, uint64_t n, void **values);
+
+/*  Removes every key for which `predicate(key, value, ctx)` returns non-zero
+    and then compacts the bucket array in a single pass. Values the hashmap
+    owns are free'd; others can be cleaned up by the predicate. Returns the
+    number of keys removed. */
+uint64_t hashmap_remove_if(HashMap *h, hashmap_predicate_function predicate, void *ctx);
+
+/*  Moves every node of `src` into `dst`, leaving `src` empty but still
+    initialized. `dst` is grown once up front, keys are not copied, and the
+    stored hashes are reused when both maps use the same hash function and
+    seed. When a key is in both maps, `conflict(key, dst_value, src_value, ctx)`
+    returns the value to keep (the `dst` value is kept if `conflict` is NULL).
+    Values the hashmaps own that are not kept are free'd; the kept value keeps
+    the ownership it had in its map. Returns HASHMAP_FAILURE if `dst` could
+    not be grown, memory ran out part way, or the maps use different
+    allocators; the keys that were not moved, including the one that failed,
+    are left in `src`. */
+int hashmap_merge(HashMap *dst, HashMap *src, hashmap_merge_function conflict, void *ctx);
+
+/*  Initializes `dst` as a copy of `src`: the bucket and tag arrays are copied
+    as they are, including an incremental resize in progress and the Bloom
+    filter, so nothing is re-hashed or re-placed; every node and key is copied
+    with its stored hash. Values the user owns are shared; values the hashmap
+    owns are copied with `copy(key, value, ctx)`, or, if `copy` is NULL, byte
+    for byte when their size is known (see hashmap_memory_usage). Returns
+    HASHMAP_FAILURE, leaving `dst` uninitialized, if memory could not be
+    allocated or an owned value could not be copied. */
+int hashmap_clone(HashMap *dst, const HashMap *src, hashmap_copy_function copy, void *ctx);
+
+/*  Builds a read-only copy of the hashmap using a minimal perfect hash
+    (compress, hash and displace): every key gets its own entry in an array
+    of exactly `used_nodes` entries so a lookup is one probe and one key
+    comparison. The keys are copied into a single arena and the values, and
+    their ownership, move to `frozen`, leaving `h` empty but still
+    initialized. Returns HASHMAP_FAILURE, with `h` untouched, if the memory
+    could not be allocated or two keys have the same full hash. */
+int hashmap_freeze(HashMap *h, HashMapFrozen *frozen);
+
+/* Returns the value of the key in the frozen map, or NULL if not found */
+void* hashmap_frozen_get(const HashMapFrozen *frozen, const char *key);
+
+/* frees the frozen map along with the values that it owns */
+void hashmap_frozen_destroy(HashMapFrozen *frozen);
+
+/*  Initialize an insertion ordered compact map with an index of `num_els`
+    slots (at least 8) and room for `num_els` / 2 entries before it grows.
+    Lookups probe the small index of entry positions, and iteration only
+    reads the dense entries array, in insertion order. Removed entries leave
+    a hole in the array, still taking up room, until it next resizes. The
+    keys are copied; the values always belong to the user. */
+int hashmap_compact_init(HashMapCompact *c, uint64_t num_els, hashmap_hash_function hash_function);
+
+/* frees the index, the entries and the keys */
+void hashmap_compact_destroy(HashMapCompact *c);
+
+/*  Add the key, or replace its value in place (keeping its position in the
+    order); returns the previous value, or `value` if the key is new, so it
+    can be freed as needed. Returns NULL if the memory could not be allocated */
+void* hashmap_compact_set(HashMapCompact *c, const char *key, void *value);
+
+/* Returns the value of the key, or NULL if not found */
+void* hashmap_compact_get(const HashMapCompact *c, const char *key);
+
+/* Removes the key, returning its value, or NULL if not found */
+void* hashmap_compact_remove(HashMapCompact *c, const char *key);
+
+/* call fn(key, value, ctx) for every key in insertion order */
+void hashmap_compact_for_each(const HashMapCompact *c, hashmap_visit_function fn, void *ctx);
+
+/*  Returns an array of all the keys in insertion order. NOTE: the user must
+    free each key and the array, the same as hashmap_keys */
+char** hashmap_compact_keys(const HashMapCompact *c);
+
 /*  Returns an array of all keys in the hashmap.
     NOTE: It is up to the caller to free the array returned. */
 char** hashmap_keys(const HashMap *h);
 
+/*  Returns an array of all keys in the hashmap sorted by `order`
+    (HASHMAP_SORT_KEYS or HASHMAP_SORT_HASH) using a radix sort. The keys are
+    not copied; they point to the keys in the hashmap and are valid until the
+    key is removed. If `values` is not NULL it is set to an array of the values
+    in the same order. Returns NULL if the memory could not be allocated.
+    NOTE: It is up to the caller to free the arrays returned (but not the keys) */
+const char** hashmap_keys_sorted(const HashMap *h, int order, void ***values);
+
+/* Calls `fn(key, value, ctx)` for every key in the hashmap */
+void hashmap_for_each(const HashMap *h, hashmap_visit_function fn, void *ctx);
+
+/*  Calls `fn(key, value, ctx)` for every key in the hashmap, splitting the
+    bucket array into one range per thread. `fn` is called concurrently so it
+    must be thread safe and must not modify the hashmap. Uses OpenMP when
+    compiled with it (`nthreads` <= 0 uses the OpenMP default), otherwise
+    pthreads when HASHMAP_PTHREADS is defined, otherwise it runs serially. */
+int hashmap_parallel_for_each(const HashMap *h, hashmap_visit_function fn, void *ctx, int nthreads);
+
+/*  Initializes `nthreads` hashmaps of `num_els` buckets (with OpenMP,
+    `nthreads` <= 0 uses the OpenMP default), one per thread. Each thread adds
+    to its own map from `hashmap_aggregator_local` with no locking and
+    `hashmap_aggregator_reduce` then combines them. */
+int hashmap_aggregator_init(HashMapAggregator *a, int nthreads, uint64_t num_els, hashmap_hash_function hash_function);
+
+/* Returns the hashmap of thread `thread` (such as `omp_get_thread_num()`) */
+HashMap* hashmap_aggregator_local(HashMapAggregator *a, int thread);
+
+/*  Moves every key of the thread maps into `dst`, calling `combine(key,
+    dst_value, src_value, ctx)` (as in `hashmap_merge`) whenever a key is
+    already present. The keys are first split by hash into one partition per
+    thread and the partitions are combined in parallel (OpenMP, else pthreads
+    when HASHMAP_PTHREADS is defined, else serially), so `combine` may be
+    called concurrently for different keys. The thread maps are left empty
+    and can be reused. `dst` must use the default allocator, as the thread
+    maps do. Returns HASHMAP_FAILURE if memory ran out; the keys that did not
+    reach `dst` are then left in the thread maps (combined where they met),
+    so nothing is lost and the reduce can be retried. */
+int hashmap_aggregator_reduce(HashMapAggregator *a, HashMap *dst, hashmap_merge_function combine, void *ctx);
+
+/* frees the thread maps and everything in them */
+void hashmap_aggregator_destroy(HashMapAggregator *a);
+
+/*  Writes the hashmap to the file descriptor as a header with the number of
+    keys followed by a length-prefixed record per key, buffered in fixed size
+    chunks so the memory used does not depend on the size of the hashmap.
+    `encoder(key, value, buf, buf_len, ctx)` writes the value into `buf` and
+    returns its length; if that is more than `buf_len` it is called again with
+    a big enough buffer. If `encoder` is NULL the values are written as
+    c-strings, and NULL values are marked so they read back as NULL. Returns
+    HASHMAP_FAILURE on a write error or a key or value of 2 GB or more. */
+int hashmap_write_stream(const HashMap *h, int fd, hashmap_value_encoder encoder, void *ctx);
+
+/*  Reads keys written by `hashmap_write_stream` into the hashmap, which is
+    grown once from the number of keys in the header (up to about a million;
+    past that it grows as the keys arrive). `decoder(key, buf, len, ctx)`
+    returns the value to store; the hashmap owns it and will free it (as with
+    `hashmap_set_alt`). If `decoder` is NULL the values are read as c-strings.
+    NULL values written without an encoder are stored as NULL either way.
+    Returns HASHMAP_FAILURE on a read error or malformed stream. */
+int hashmap_read_stream(HashMap *h, int fd, hashmap_value_decoder decoder, void *ctx);
+
 /* Prints out some basic stats about the hashmap */
 void hashmap_stats(const HashMap *h);
 
@@ -123,6 +540,14 @@ char* hashmap_set_string(HashMap *h, const char *key, const char *value);
 /* Return the fullness of the hashmap */
 float hashmap_get_fullness(const HashMap *h);
 
+/*  Bytes used by the hashmap, split into the bucket arrays, nodes, keys, owned
+    values and allocator overhead; returns the total and fills in breakdown if
+    it is not NULL. The counts are kept up to date as keys are set and removed
+    so this does not scan the map. Values added with hashmap_set_alt are only
+    counted when the allocator can report their size (glibc malloc). The
+    overhead assumes an 8 byte header and 16 byte alignment per allocation. */
+uint64_t hashmap_memory_usage(const HashMap *h, hashmap_memory *breakdown);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -0,0 +1,358 @@
+#ifndef BARRUST_HASH_MAP_HPP__
+#define BARRUST_HASH_MAP_HPP__
+/*******************************************************************************
+***
+***     Author: Tyler Barrus
+***     email:  barrust@gmail.com
+***
+***     Version: 0.8.1
+***     Purpose: Header-only C++ (17) version of the hashmap; the hash and
+***              equality functors are template parameters so they can be
+***              inlined and the keys and values are stored in the bucket
+***              array instead of being boxed behind pointers
+***
+***     License: MIT 2015
+***
+***     URL: https://github.com/barrust/hashmap
+***
+*******************************************************************************/
+
+#include <cstddef>          /* size_t */
+#include <cstdint>          /* uint64_t */
+#include <functional>       /* std::equal_to, std::hash */
+#include <memory>           /* std::unique_ptr */
+#include <new>              /* placement new */
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>          /* std::move, std::forward */
+
+namespace barrust {
+
+/*******************************************************************************
+***    Hash functors
+*******************************************************************************/
+
+/*  FNV-1a over the bytes of the string; identical to the default hash of the C
+    library so both produce the same layout for the same keys. Transparent so
+    that `std::string` keyed maps accept `std::string_view` and `const char*`
+    lookups without building a temporary string. */
+struct string_hash {
+    using is_transparent = void;
+
+    uint64_t operator()(std::string_view key) const noexcept {
+        uint64_t h = 14695981039346656037ULL; // FNV_OFFSET 64 bit
+        for (unsigned char c : key) {
+            h = h ^ c;
+            h = h * 1099511628211ULL; // FNV_PRIME 64 bit
+        }
+        return h;
+    }
+};
+
+/*  splitmix64 finalizer; integers are often sequential so they need mixing
+    before the modulo in the probe */
+struct integer_hash {
+    uint64_t operator()(uint64_t key) const noexcept {
+        key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+        return key ^ (key >> 31);
+    }
+};
+
+template <class K, class Enable = void>
+struct hash {
+    uint64_t operator()(const K &key) const noexcept(noexcept(std::hash<K>{}(key))) {
+        return integer_hash{}(static_cast<uint64_t>(std::hash<K>{}(key)));
+    }
+};
+
+template <class K>
+struct hash<K, typename std::enable_if<std::is_integral<K>::value || std::is_enum<K>::value>::type> {
+    uint64_t operator()(K key) const noexcept {
+        return integer_hash{}(static_cast<uint64_t>(key));
+    }
+};
+
+template <>
+struct hash<std::string> : string_hash {};
+
+template <>
+struct hash<std::string_view> : string_hash {};
+
+
+/*******************************************************************************
+***    HashMap
+***
+***    Same design as the C library: open addressing with linear probing, the
+***    full hash stored next to each entry so it never needs to be recomputed,
+***    and removal re-laying out the rest of the cluster instead of leaving
+***    tombstones. The table doubles once it is half full.
+***
+***    Pointers returned by `get` are invalidated by any `set` or `remove`. A
+***    moved-from map is empty and allocates a new table on its next insert.
+*******************************************************************************/
+template <class K, class V, class Hash = barrust::hash<K>, class Eq = std::equal_to<>>
+class HashMap {
+public:
+    using key_type = K;
+    using mapped_type = V;
+    using size_type = uint64_t;
+
+    explicit HashMap(size_type num_els = 1024, const Hash &hash = Hash(), const Eq &eq = Eq())
+        : slots_(new slot[num_els < MIN_NODES ? MIN_NODES : num_els]),
+          number_nodes_(num_els < MIN_NODES ? MIN_NODES : num_els), used_nodes_(0), hash_(hash), eq_(eq) {}
+
+    HashMap(const HashMap &) = delete;
+    HashMap &operator=(const HashMap &) = delete;
+
+    HashMap(HashMap &&other) noexcept
+        : slots_(std::move(other.slots_)), number_nodes_(other.number_nodes_),
+          used_nodes_(other.used_nodes_), hash_(std::move(other.hash_)), eq_(std::move(other.eq_)) {
+        other.number_nodes_ = 0;
+        other.used_nodes_ = 0;
+    }
+
+    HashMap &operator=(HashMap &&other) noexcept {
+        if (this != &other) {
+            clear();
+            slots_ = std::move(other.slots_);
+            number_nodes_ = other.number_nodes_;
+            used_nodes_ = other.used_nodes_;
+            hash_ = std::move(other.hash_);
+            eq_ = std::move(other.eq_);
+            other.number_nodes_ = 0;
+            other.used_nodes_ = 0;
+        }
+        return *this;
+    }
+
+    ~HashMap() { clear(); }
+
+    size_type size() const noexcept { return used_nodes_; }
+    size_type number_nodes() const noexcept { return number_nodes_; }
+    bool empty() const noexcept { return used_nodes_ == 0; }
+    float fullness() const noexcept { return (number_nodes_ == 0) ? 0.0f : used_nodes_ / (float)number_nodes_ * 100.0f; }
+
+    /*  Adds the key or replaces the value if it is already present. Returns
+        true if the key was newly inserted. */
+    template <class Q, class W>
+    bool set(Q &&key, W &&value) {
+        bool inserted;
+        V *v = get_or_insert_impl(std::forward<Q>(key), inserted, std::forward<W>(value));
+        if (!inserted) {
+            *v = std::forward<W>(value);
+        }
+        return inserted;
+    }
+
+    /*  Returns the value for the key, default constructing it first if the key
+        is not present; a single hash and probe either way */
+    template <class Q>
+    V &get_or_insert(Q &&key, bool *inserted = nullptr) {
+        bool ins;
+        V *v = get_or_insert_impl(std::forward<Q>(key), ins);
+        if (inserted != nullptr) {
+            *inserted = ins;
+        }
+        return *v;
+    }
+
+    template <class Q>
+    V &operator[](Q &&key) { return get_or_insert(std::forward<Q>(key)); }
+
+    /* Returns a pointer to the value of the found key, or nullptr if not found */
+    template <class Q>
+    V *get(const Q &key) noexcept {
+        size_type i;
+        return find(key, hash_(key), i) ? &slots_[i].entry()->second : nullptr;
+    }
+
+    template <class Q>
+    const V *get(const Q &key) const noexcept {
+        size_type i;
+        return find(key, hash_(key), i) ? &slots_[i].entry()->second : nullptr;
+    }
+
+    template <class Q>
+    bool contains(const Q &key) const noexcept { return get(key) != nullptr; }
+
+    /* Removes the key; returns false if it was not present */
+    template <class Q>
+    bool remove(const Q &key) {
+        size_type i;
+        if (!find(key, hash_(key), i)) {
+            return false;
+        }
+        slots_[i].destroy();
+        --used_nodes_;
+        relayout(i);
+        return true;
+    }
+
+    /*  Moves the value out of the map before removing the key; returns false
+        if the key was not present */
+    template <class Q>
+    bool take(const Q &key, V &out) {
+        size_type i;
+        if (!find(key, hash_(key), i)) {
+            return false;
+        }
+        out = std::move(slots_[i].entry()->second);
+        slots_[i].destroy();
+        --used_nodes_;
+        relayout(i);
+        return true;
+    }
+
+    void clear() noexcept {
+        for (size_type i = 0; i < number_nodes_; ++i) {
+            slots_[i].destroy();
+        }
+        used_nodes_ = 0;
+    }
+
+    /* grow the table so that `num_keys` can be held without resizing */
+    void reserve(size_type num_keys) {
+        size_type num_nodes = (number_nodes_ < MIN_NODES) ? MIN_NODES : number_nodes_;
+        while (num_keys >= num_nodes * MAX_FULLNESS) {
+            num_nodes *= 2;
+        }
+        if (num_nodes != number_nodes_) {
+            rehash(num_nodes);
+        }
+    }
+
+    /* call fn(key, value) for every entry */
+    template <class Fn>
+    void for_each(Fn &&fn) {
+        for (size_type i = 0; i < number_nodes_; ++i) {
+            if (slots_[i].used) {
+                fn(static_cast<const K &>(slots_[i].entry()->first), slots_[i].entry()->second);
+            }
+        }
+    }
+
+    template <class Fn>
+    void for_each(Fn &&fn) const {
+        for (size_type i = 0; i < number_nodes_; ++i) {
+            if (slots_[i].used) {
+                fn(static_cast<const K &>(slots_[i].entry()->first), static_cast<const V &>(slots_[i].entry()->second));
+            }
+        }
+    }
+
+private:
+    /* higher than the C library since the entries themselves live in the table */
+    static constexpr double MAX_FULLNESS = 0.5;
+    /* with fewer than 2 slots the table could fill before it grows and a probe would never end */
+    static constexpr size_type MIN_NODES = 2;
+
+    using entry_type = std::pair<K, V>;
+
+    struct slot {
+        uint64_t hash = 0;
+        bool used = false;
+        alignas(entry_type) unsigned char storage[sizeof(entry_type)];
+
+        entry_type *entry() noexcept { return std::launder(reinterpret_cast<entry_type *>(storage)); }
+        const entry_type *entry() const noexcept { return std::launder(reinterpret_cast<const entry_type *>(storage)); }
+
+        template <class... Args>
+        void construct(uint64_t h, Args &&...args) {
+            ::new (static_cast<void *>(storage)) entry_type(std::forward<Args>(args)...);
+            hash = h;
+            used = true;
+        }
+
+        void destroy() noexcept {
+            if (used) {
+                entry()->~entry_type();
+                used = false;
+            }
+        }
+
+        /* move the entry from `other` into this (empty) slot */
+        void take(slot &other) noexcept(std::is_nothrow_move_constructible<entry_type>::value) {
+            construct(other.hash, std::move(*other.entry()));
+            other.destroy();
+        }
+    };
+
+    /*  Probe for the key; on success `i` is its slot, otherwise `i` is the
+        first empty slot in the cluster */
+    template <class Q>
+    bool find(const Q &key, uint64_t hash, size_type &i) const noexcept {
+        if (number_nodes_ == 0) {  // moved from
+            i = 0;
+            return false;
+        }
+        i = hash % number_nodes_;
+        while (slots_[i].used) {
+            if (slots_[i].hash == hash && eq_(slots_[i].entry()->first, key)) {
+                return true;
+            }
+            i = (i + 1 == number_nodes_) ? 0 : i + 1;
+        }
+        return false;
+    }
+
+    template <class Q, class... W>
+    V *get_or_insert_impl(Q &&key, bool &inserted, W &&...value) {
+        if (used_nodes_ >= number_nodes_ * MAX_FULLNESS) {
+            rehash((number_nodes_ == 0) ? MIN_NODES : number_nodes_ * 2);
+        }
+        const uint64_t h = hash_(key);
+        size_type i;
+        inserted = !find(key, h, i);
+        if (inserted) {
+            slots_[i].construct(h, std::piecewise_construct, std::forward_as_tuple(std::forward<Q>(key)),
+                                std::forward_as_tuple(std::forward<W>(value)...));
+            ++used_nodes_;
+        }
+        return &slots_[i].entry()->second;
+    }
+
+    /* re-insert every entry into a new table using the stored hash */
+    void rehash(size_type num_els) {
+        std::unique_ptr<slot[]> tmp(new slot[num_els]);
+        for (size_type j = 0; j < number_nodes_; ++j) {
+            if (slots_[j].used) {
+                size_type i = slots_[j].hash % num_els;
+                while (tmp[i].used) {
+                    i = (i + 1 == num_els) ? 0 : i + 1;
+                }
+                tmp[i].take(slots_[j]);
+            }
+        }
+        slots_ = std::move(tmp);
+        number_nodes_ = num_els;
+    }
+
+    /*  after removing the entry at `loc` move any entry further along the
+        cluster back toward its home slot so that probes do not stop early */
+    void relayout(size_type loc) noexcept {
+        size_type hole = loc;
+        size_type i = (loc + 1 == number_nodes_) ? 0 : loc + 1;
+        while (slots_[i].used) {
+            const size_type home = slots_[i].hash % number_nodes_;
+            /* can the entry at i move to the hole, i.e. is the hole between its home and i */
+            const bool movable = (hole <= i) ? (home <= hole || home > i) : (home <= hole && home > i);
+            if (movable) {
+                slots_[hole].take(slots_[i]);
+                hole = i;
+            }
+            i = (i + 1 == number_nodes_) ? 0 : i + 1;
+        }
+    }
+
+    std::unique_ptr<slot[]> slots_;
+    size_type number_nodes_;
+    size_type used_nodes_;
+    Hash hash_;
+    Eq eq_;
+};
+
+} // namespace barrust
+
+#endif /* END HASHMAP HPP HEADER */
@@ -0,0 +1,259 @@
+#ifndef BARRUST_HASH_MAP_TYPED_H__
+#define BARRUST_HASH_MAP_TYPED_H__
+/*******************************************************************************
+***
+***     Author: Tyler Barrus
+***     email:  barrust@gmail.com
+***
+***     Version: 0.8.1
+***     Purpose: Macro generated, type specialized hashmaps for C; the keys and
+***              values are stored in the bucket array and the hash and
+***              equality functions are inlined into the probe
+***
+***     License: MIT 2015
+***
+***     URL: https://github.com/barrust/hashmap
+***
+*******************************************************************************/
+
+#include <stdlib.h>         /* malloc, calloc, free */
+#include <string.h>         /* strcmp */
+#include "hashmap.h"        /* HASHMAP_SUCCESS, HASHMAP_FAILURE */
+
+
+/*******************************************************************************
+***    Hash and equality functions
+*******************************************************************************/
+
+/*  splitmix64 finalizer; integers are often sequential so they need mixing
+    before the modulo in the probe */
+static inline uint64_t hashmap_typed_hash_int(uint64_t key) {
+    key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+    return key ^ (key >> 31);
+}
+
+/* FNV-1a; the same as the default hash of the library */
+static inline uint64_t hashmap_typed_hash_string(const char *key) {
+    uint64_t h = 14695981039346656037ULL; // FNV_OFFSET 64 bit
+    for (; *key != '\0'; ++key) {
+        h = h ^ (unsigned char)*key;
+        h = h * 1099511628211ULL; // FNV_PRIME 64 bit
+    }
+    return h;
+}
+
+#define hashmap_typed_eq_int(a, b)       ((a) == (b))
+#define hashmap_typed_eq_string(a, b)    (strcmp((a), (b)) == 0)
+
+
+/*******************************************************************************
+***    HASHMAP_DECLARE
+***
+***    HASHMAP_DECLARE(name, key_type, val_type, hash_fn, eq_fn) generates the type
+***    `name` and the functions below, all prefixed with `name_`. hash_fn(key)
+***    returns a uint64_t and eq_fn(a, b) is non-zero if the keys are equal;
+***    either may be a function or a function-like macro.
+***
+***    Same design as the library: open addressing with linear probing, the
+***    full hash stored next to each entry, and removal re-laying out the rest
+***    of the cluster instead of leaving tombstones. Keys and values are copied
+***    into the table as is, so a `const char*` key must outlive its entry.
+***    The table doubles once it is half full. The library's probe is static to
+***    hashmap.c and walks boxed nodes, so the probe here is its inlined twin.
+***    A destroyed map is empty and allocates a new table on its next insert.
+***
+***    Pointers returned by `get` and `get_or_insert` are invalidated by any
+***    `set`, `get_or_insert` or `remove`.
+***
+***        int    name_init(name *m, uint64_t num_els);
+***        void   name_destroy(name *m);
+***        void   name_clear(name *m);
+***        int    name_reserve(name *m, uint64_t num_keys);
+***        int    name_set(name *m, key_type key, val_type value);
+***        val_type* name_get(const name *m, key_type key);
+***        val_type* name_get_or_insert(name *m, key_type key, int *inserted);
+***        int    name_remove(name *m, key_type key, val_type *value);
+***        void   name_for_each(name *m, void (*fn)(key_type, val_type*, void*), void *ctx);
+***        float  name_get_fullness(const name *m);
+***        void   name_stats(const name *m, uint64_t *max_probe, float *avg_probe);
+***
+***    Like the khash macros, the declaration is not followed by a semicolon:
+***
+***        HASHMAP_DECLARE(intmap, uint64_t, int, hashmap_typed_hash_int, hashmap_typed_eq_int)
+*******************************************************************************/
+#define HASHMAP_TYPED_MAX_FULLNESS 0.5
+#define HASHMAP_TYPED_MIN_NODES 2   /* one slot would fill before growing and a probe would never end */
+
+#define HASHMAP_DECLARE(name, key_type, val_type, hash_fn, eq_fn)                                               \
+typedef struct name##_slot {                                                                                    \
+    uint64_t hash;                                                                                              \
+    key_type key;                                                                                               \
+    val_type value;                                                                                             \
+    unsigned char used;                                                                                         \
+} name##_slot;                                                                                                  \
+                                                                                                                \
+typedef struct name {                                                                                           \
+    name##_slot *slots;                                                                                         \
+    uint64_t number_nodes;                                                                                      \
+    uint64_t used_nodes;                                                                                        \
+} name;                                                                                                         \
+                                                                                                                \
+static inline int name##_init(name *m, uint64_t num_els) {                                                      \
+    m->number_nodes = (num_els < HASHMAP_TYPED_MIN_NODES) ? HASHMAP_TYPED_MIN_NODES : num_els;                  \
+    m->used_nodes = 0;                                                                                          \
+    m->slots = (name##_slot*)calloc(m->number_nodes, sizeof(name##_slot));                                      \
+    return (m->slots == NULL) ? HASHMAP_FAILURE : HASHMAP_SUCCESS;                                              \
+}                                                                                                               \
+                                                                                                                \
+static inline void name##_destroy(name *m) {                                                                    \
+    free(m->slots);                                                                                             \
+    m->slots = NULL;                                                                                            \
+    m->number_nodes = 0;                                                                                        \
+    m->used_nodes = 0;                                                                                          \
+}                                                                                                               \
+                                                                                                                \
+static inline void name##_clear(name *m) {                                                                      \
+    if (m->number_nodes != 0) {                                                                                 \
+        memset(m->slots, 0, m->number_nodes * sizeof(name##_slot));                                             \
+    }                                                                                                           \
+    m->used_nodes = 0;                                                                                          \
+}                                                                                                               \
+                                                                                                                \
+/* on success `i` is the key's slot, otherwise the first open slot of the cluster */                            \
+static inline int name##__find(const name *m, key_type key, uint64_t hash, uint64_t *i) {                       \
+    if (m->number_nodes == 0) {  /* destroyed; a set allocates a new table */                                   \
+        *i = 0;                                                                                                 \
+        return 0;                                                                                               \
+    }                                                                                                           \
+    uint64_t j = hash % m->number_nodes;                                                                        \
+    while (m->slots[j].used != 0) {                                                                             \
+        if (m->slots[j].hash == hash && eq_fn(m->slots[j].key, key)) {                                          \
+            *i = j;                                                                                             \
+            return 1;                                                                                           \
+        }                                                                                                       \
+        j = (j + 1 == m->number_nodes) ? 0 : j + 1;                                                             \
+    }                                                                                                           \
+    *i = j;                                                                                                     \
+    return 0;                                                                                                   \
+}                                                                                                               \
+                                                                                                                \
+/* re-insert every entry into a new table using the stored hash */                                              \
+static inline int name##__rehash(name *m, uint64_t num_els) {                                                   \
+    name##_slot *slots = (name##_slot*)calloc(num_els, sizeof(name##_slot));                                    \
+    if (slots == NULL) {return HASHMAP_FAILURE;}                                                                \
+    for (uint64_t j = 0; j < m->number_nodes; ++j) {                                                            \
+        if (m->slots[j].used != 0) {                                                                            \
+            uint64_t i = m->slots[j].hash % num_els;                                                            \
+            while (slots[i].used != 0) {                                                                        \
+                i = (i + 1 == num_els) ? 0 : i + 1;                                                             \
+            }                                                                                                   \
+            slots[i] = m->slots[j];                                                                             \
+        }                                                                                                       \
+    }                                                                                                           \
+    free(m->slots);                                                                                             \
+    m->slots = slots;                                                                                           \
+    m->number_nodes = num_els;                                                                                  \
+    return HASHMAP_SUCCESS;                                                                                     \
+}                                                                                                               \
+                                                                                                                \
+static inline int name##_reserve(name *m, uint64_t num_keys) {                                                  \
+    uint64_t num_nodes = (m->number_nodes == 0) ? HASHMAP_TYPED_MIN_NODES : m->number_nodes;                    \
+    while (num_keys >= num_nodes * HASHMAP_TYPED_MAX_FULLNESS) {                                                \
+        num_nodes *= 2;                                                                                         \
+    }                                                                                                           \
+    return (num_nodes == m->number_nodes) ? HASHMAP_SUCCESS : name##__rehash(m, num_nodes);                     \
+}                                                                                                               \
+                                                                                                                \
+/* the value of the key, or NULL if it is not present */                                                        \
+static inline val_type* name##_get(const name *m, key_type key) {                                               \
+    uint64_t i;                                                                                                 \
+    return name##__find(m, key, hash_fn(key), &i) ? &m->slots[i].value : NULL;                                  \
+}                                                                                                               \
+                                                                                                                \
+/*  single hash and probe; a missing key is added with a zeroed value. Returns                                  \
+    NULL only if growing the table failed */                                                                    \
+static inline val_type* name##_get_or_insert(name *m, key_type key, int *inserted) {                            \
+    const uint64_t grown = (m->number_nodes == 0) ? HASHMAP_TYPED_MIN_NODES : m->number_nodes * 2;              \
+    if (m->used_nodes >= m->number_nodes * HASHMAP_TYPED_MAX_FULLNESS &&                                        \
+        name##__rehash(m, grown) == HASHMAP_FAILURE) {                                                          \
+        return NULL;                                                                                            \
+    }                                                                                                           \
+    const uint64_t hash = hash_fn(key);                                                                         \
+    uint64_t i;                                                                                                 \
+    int found = name##__find(m, key, hash, &i);                                                                 \
+    if (!found) {                                                                                               \
+        memset(&m->slots[i], 0, sizeof(name##_slot));                                                           \
+        m->slots[i].hash = hash;                                                                                \
+        m->slots[i].key = key;                                                                                  \
+        m->slots[i].used = 1;                                                                                   \
+        ++m->used_nodes;                                                                                        \
+    }                                                                                                           \
+    if (inserted != NULL) {                                                                                     \
+        *inserted = !found;                                                                                     \
+    }                                                                                                           \
+    return &m->slots[i].value;                                                                                  \
+}                                                                                                               \
+                                                                                                                \
+/* add the key or replace its value */                                                                          \
+static inline int name##_set(name *m, key_type key, val_type value) {                                           \
+    val_type *v = name##_get_or_insert(m, key, NULL);                                                           \
+    if (v == NULL) {return HASHMAP_FAILURE;}                                                                    \
+    *v = value;                                                                                                 \
+    return HASHMAP_SUCCESS;                                                                                     \
+}                                                                                                               \
+                                                                                                                \
+/*  remove the key, copying its value out first if `value` is not NULL;                                         \
+    returns HASHMAP_FAILURE if the key was not present */                                                       \
+static inline int name##_remove(name *m, key_type key, val_type *value) {                                       \
+    uint64_t i;                                                                                                 \
+    if (!name##__find(m, key, hash_fn(key), &i)) {return HASHMAP_FAILURE;}                                      \
+    if (value != NULL) {                                                                                        \
+        *value = m->slots[i].value;                                                                             \
+    }                                                                                                           \
+    m->slots[i].used = 0;                                                                                       \
+    --m->used_nodes;                                                                                            \
+    /* move the rest of the cluster back toward its home slots so probes do not stop early */                   \
+    uint64_t hole = i, j = (i + 1 == m->number_nodes) ? 0 : i + 1;                                              \
+    while (m->slots[j].used != 0) {                                                                             \
+        uint64_t home = m->slots[j].hash % m->number_nodes;                                                     \
+        int movable = (hole <= j) ? (home <= hole || home > j) : (home <= hole && home > j);                    \
+        if (movable) {                                                                                          \
+            m->slots[hole] = m->slots[j];                                                                       \
+            m->slots[j].used = 0;                                                                               \
+            hole = j;                                                                                           \
+        }                                                                                                       \
+        j = (j + 1 == m->number_nodes) ? 0 : j + 1;                                                             \
+    }                                                                                                           \
+    return HASHMAP_SUCCESS;                                                                                     \
+}                                                                                                               \
+                                                                                                                \
+static inline void name##_for_each(name *m, void (*fn)(key_type, val_type*, void*), void *ctx) {                \
+    for (uint64_t i = 0; i < m->number_nodes; ++i) {                                                            \
+        if (m->slots[i].used != 0) {                                                                            \
+            fn(m->slots[i].key, &m->slots[i].value, ctx);                                                       \
+        }                                                                                                       \
+    }                                                                                                           \
+}                                                                                                               \
+                                                                                                                \
+static inline float name##_get_fullness(const name *m) {                                                        \
+    return (m->number_nodes == 0) ? 0 : (float)m->used_nodes / m->number_nodes * 100;                           \
+}                                                                                                               \
+                                                                                                                \
+/*  the longest and the average probe of the keys, counted as hashmap_stats                                     \
+    counts them: 1 for a key in its home slot */                                                                \
+static inline void name##_stats(const name *m, uint64_t *max_probe, float *avg_probe) {                         \
+    uint64_t max = 0, sum = 0;                                                                                  \
+    for (uint64_t i = 0; i < m->number_nodes; ++i) {                                                            \
+        if (m->slots[i].used != 0) {                                                                            \
+            uint64_t home = m->slots[i].hash % m->number_nodes;                                                 \
+            uint64_t probe = (i < home) ? i + m->number_nodes - home + 1 : 1 + i - home;                        \
+            sum += probe;                                                                                       \
+            max = (probe > max) ? probe : max;                                                                  \
+        }                                                                                                       \
+    }                                                                                                           \
+    *max_probe = max;                                                                                           \
+    *avg_probe = (m->used_nodes == 0) ? 0 : (float)sum / m->used_nodes;                                         \
+}
+
+#endif /* END HASHMAP TYPED HEADER */
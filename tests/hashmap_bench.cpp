@@ -0,0 +1,279 @@
+/*
+	Compare the C hashmap, the C typed hashmap, the C++ template hashmap, and
+	std::unordered_map
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "timing.h"
+#include "../src/hashmap.h"
+#include "../src/hashmap.hpp"
+#include "../src/hashmap_typed.h"
+
+
+#define KEY_LEN 25 // much larger than it needs to be
+
+#define KNRM  "\x1B[0m"
+#define KRED  "\x1B[31m"
+#define KGRN  "\x1B[32m"
+#define KCYN  "\x1B[36m"
+
+HASHMAP_DECLARE(intmap, uint64_t, int, hashmap_typed_hash_int, hashmap_typed_eq_int)
+
+// private functions
+void success_or_failure(int res);
+void print_timing(const char *name, Timing *t);
+
+int main() {
+    printf("Benchmarking Hashmap version %s\n\n", hashmap_get_version());
+
+    const int num_els = 1000000;
+    const int rounds = 3;
+    char key[KEY_LEN];
+    int i, r, res = 0;
+    long long sum = 0;
+    Timing t;
+
+    /* C library */
+    HashMap h;
+    hashmap_init(&h);
+    timing_start(&t);
+    for (i = 0; i < num_els; ++i) {
+        sprintf(key, "%d", i);
+        hashmap_set_int(&h, key, i);
+    }
+    print_timing("C API: insert", &t);
+
+    timing_start(&t);
+    for (r = 0; r < rounds; ++r) {
+        for (i = 0; i < num_els; ++i) {
+            sprintf(key, "%d", i);
+            sum += *(int*)hashmap_get(&h, key);
+        }
+    }
+    print_timing("C API: lookup", &t);
+
+    int found = 0;
+    timing_start(&t);
+    for (i = num_els; i < 2 * num_els; ++i) {
+        sprintf(key, "%d", i);
+        found += hashmap_get(&h, key) != NULL;
+    }
+    print_timing("C API: lookup misses", &t);
+
+    hashmap_enable_bloom(&h);
+    timing_start(&t);
+    for (i = num_els; i < 2 * num_els; ++i) {
+        sprintf(key, "%d", i);
+        found += hashmap_get(&h, key) != NULL;
+    }
+    print_timing("C API: lookup misses (Bloom filter)", &t);
+    res = (found == 0) ? 0 : -1;
+    hashmap_destroy(&h);
+
+    char **keys = (char**)malloc(num_els * sizeof(char*));
+    void **values = (void**)malloc(num_els * sizeof(void*));
+    for (i = 0; i < num_els; ++i) {
+        keys[i] = (char*)malloc(KEY_LEN);
+        sprintf(keys[i], "%d", i);
+        values[i] = keys[i];
+    }
+    hashmap_init(&h);
+    timing_start(&t);
+    uint64_t num_set = hashmap_set_many(&h, (const char* const*)keys, values, num_els, NULL);
+    print_timing("C API: bulk insert (hashmap_set_many)", &t);
+    int bulk = (num_set == (uint64_t)num_els && h.used_nodes == (uint64_t)num_els) ? 0 : -1;
+    hashmap_destroy(&h);
+    for (i = 0; i < num_els; ++i) {
+        free(keys[i]);
+    }
+    free(keys);
+    free(values);
+
+    /* C++ template */
+    barrust::HashMap<std::string, int> cpp;
+    timing_start(&t);
+    for (i = 0; i < num_els; ++i) {
+        int len = sprintf(key, "%d", i);
+        cpp.set(std::string_view(key, len), i);
+    }
+    print_timing("barrust::HashMap: insert", &t);
+
+    timing_start(&t);
+    for (r = 0; r < rounds; ++r) {
+        for (i = 0; i < num_els; ++i) {
+            int len = sprintf(key, "%d", i);
+            sum -= *cpp.get(std::string_view(key, len));
+        }
+    }
+    print_timing("barrust::HashMap: lookup", &t);
+
+    /* std::unordered_map */
+    std::unordered_map<std::string, int> um;
+    timing_start(&t);
+    for (i = 0; i < num_els; ++i) {
+        int len = sprintf(key, "%d", i);
+        um.emplace(std::string(key, len), i);
+    }
+    print_timing("std::unordered_map: insert", &t);
+
+    timing_start(&t);
+    for (r = 0; r < rounds; ++r) {
+        for (i = 0; i < num_els; ++i) {
+            int len = sprintf(key, "%d", i);
+            sum += um.find(std::string(key, len))->second;  /* heterogeneous lookup is C++20 */
+        }
+    }
+    print_timing("std::unordered_map: lookup", &t);
+
+    /* integer keys */
+    long long isum = 0;
+    intmap im;
+    intmap_init(&im, 1024);
+    timing_start(&t);
+    for (i = 0; i < num_els; ++i) {
+        intmap_set(&im, (uint64_t)i, i);
+    }
+    print_timing("\nC typed map (integer keys): insert", &t);
+
+    timing_start(&t);
+    for (r = 0; r < rounds; ++r) {
+        for (i = 0; i < num_els; ++i) {
+            isum += *intmap_get(&im, (uint64_t)i);
+        }
+    }
+    print_timing("C typed map (integer keys): lookup", &t);
+    intmap_destroy(&im);
+
+    barrust::HashMap<uint64_t, int> cppi;
+    timing_start(&t);
+    for (i = 0; i < num_els; ++i) {
+        cppi.set((uint64_t)i, i);
+    }
+    print_timing("barrust::HashMap (integer keys): insert", &t);
+
+    timing_start(&t);
+    for (r = 0; r < rounds; ++r) {
+        for (i = 0; i < num_els; ++i) {
+            isum -= *cppi.get((uint64_t)i);
+        }
+    }
+    print_timing("barrust::HashMap (integer keys): lookup", &t);
+
+    std::unordered_map<uint64_t, int> umi;
+    timing_start(&t);
+    for (i = 0; i < num_els; ++i) {
+        umi.emplace((uint64_t)i, i);
+    }
+    print_timing("std::unordered_map (integer keys): insert", &t);
+
+    timing_start(&t);
+    for (r = 0; r < rounds; ++r) {
+        for (i = 0; i < num_els; ++i) {
+            isum += umi.find((uint64_t)i)->second;
+        }
+    }
+    print_timing("std::unordered_map (integer keys): lookup", &t);
+
+    printf("\nC API: Misses not found with the Bloom filter: ");
+    success_or_failure(res);
+    res = 0;
+
+    printf("C API: Bulk insert set every key: ");
+    success_or_failure(bulk);
+
+    printf("C typed map: Lookups agree with std::unordered_map: ");
+    success_or_failure(isum == (long long)rounds * num_els * (num_els - 1) / 2 ? 0 : -1);
+
+    printf("C++ HashMap: Lookups agree with the C API: ");
+    success_or_failure(sum == (long long)rounds * num_els * (num_els - 1) / 2 ? 0 : -1);
+
+    printf("C++ HashMap: Correct number of elements: ");
+    success_or_failure(cpp.size() == (uint64_t)num_els ? 0 : -1);
+
+    printf("C++ HashMap: Update in place: ");
+    for (i = 0; i < num_els; ++i) {
+        sprintf(key, "%d", i);
+        cpp[key] += 1;
+    }
+    for (i = 0; i < num_els; ++i) {
+        sprintf(key, "%d", i);
+        const int *v = cpp.get(key);
+        if (v == nullptr || *v != i + 1) {
+            res = -1;
+        }
+    }
+    success_or_failure(res);
+    res = 0;
+
+    printf("C++ HashMap: Remove keys: ");
+    for (i = 0; i < num_els; i += 2) {
+        sprintf(key, "%d", i);
+        if (!cpp.remove(std::string_view(key))) {
+            res = -1;
+        }
+    }
+    for (i = 0; i < num_els; ++i) {
+        sprintf(key, "%d", i);
+        if (cpp.contains(std::string_view(key)) != (i % 2 == 1)) {
+            res = -1;
+        }
+    }
+    success_or_failure(res);
+    res = 0;
+
+    printf("C++ HashMap: Integer keys: ");
+    barrust::HashMap<uint64_t, std::string> ints;
+    for (i = 0; i < 10000; ++i) {
+        ints.set((uint64_t)i, std::to_string(i));
+    }
+    for (i = 0; i < 10000; ++i) {
+        const std::string *v = ints.get((uint64_t)i);
+        if (v == nullptr || *v != std::to_string(i)) {
+            res = -1;
+        }
+    }
+    success_or_failure(res);
+    res = 0;
+
+    printf("C++ HashMap: Misses in a one slot map: ");
+    barrust::HashMap<int, int> tiny(1);
+    tiny.set(1, 1);
+    tiny.set(2, 2);
+    res = (tiny.get(3) == nullptr && *tiny.get(2) == 2 && tiny.number_nodes() >= 4) ? 0 : -1;
+    success_or_failure(res);
+    res = 0;
+
+    printf("C++ HashMap: Moved-from map is empty and usable: ");
+    barrust::HashMap<int, int> moved(std::move(tiny));
+    barrust::HashMap<int, int> assigned;
+    assigned = std::move(moved);
+    if (!tiny.empty() || tiny.get(1) != nullptr || tiny.remove(1) || moved.get(1) != nullptr) {
+        res = -1;
+    }
+    tiny.set(5, 5);
+    moved.reserve(100);
+    moved[6] = 6;
+    if (*tiny.get(5) != 5 || *moved.get(6) != 6 || *assigned.get(2) != 2 || assigned.size() != 2) {
+        res = -1;
+    }
+    success_or_failure(res);
+    res = 0;
+}
+
+void print_timing(const char *name, Timing *t) {
+    timing_end(t);
+    printf("%s: " KCYN "%f" KNRM " seconds\n", name, timing_get_difference((*t)));
+}
+
+void success_or_failure(int res) {
+    if (res == 0) {
+        printf(KGRN "success!\n" KNRM);
+    } else {
+        printf(KRED "failure!\n" KNRM);
+    }
+}
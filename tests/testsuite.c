@@ -1,14 +1,28 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "minunit.h"
 #include "../src/hashmap.h"
+#include "../src/hashmap_typed.h"
 
 
 // the basic set to use!
 HashMap h;
 
+HASHMAP_DECLARE(intmap, uint64_t, int, hashmap_typed_hash_int, hashmap_typed_eq_int)
+HASHMAP_DECLARE(strmap, const char*, double, hashmap_typed_hash_string, hashmap_typed_eq_string)
+
+/* same as the library default hash */
+static uint64_t default_fnv1a(const char *key) {
+    uint64_t h = 14695981039346656037ULL;
+    for (; *key != '\0'; ++key) {
+        h = (h ^ (unsigned char)*key) * 1099511628211ULL;
+    }
+    return h;
+}
+
 
 void test_setup(void) {
     hashmap_init(&h);
@@ -35,6 +49,48 @@ MU_TEST(test_non_default_setup) {
     hashmap_destroy(&q);
 }
 
+MU_TEST(test_seeded_setup) {
+    HashMap q;
+    const uint64_t seed[2] = {0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL};
+    hashmap_init_seeded(&q, 500, NULL, seed);
+    mu_assert_int_eq(500, q.number_nodes);
+    mu_assert_int_eq(0, q.used_nodes);
+    mu_assert(q.seed[0] == seed[0] && q.seed[1] == seed[1], "Expected the provided seed");
+    hashmap_destroy(&q);
+
+    // random seeds differ between maps
+    HashMap a, b;
+    hashmap_init_seeded(&a, 500, NULL, NULL);
+    hashmap_init_seeded(&b, 500, NULL, NULL);
+    mu_assert(a.seed[0] != b.seed[0] || a.seed[1] != b.seed[1], "Expected different random seeds");
+    hashmap_destroy(&a);
+    hashmap_destroy(&b);
+}
+
+MU_TEST(test_flags_setup) {
+    HashMap q;
+    hashmap_init_with_flags(&q, 1 << 19, NULL, HASHMAP_HUGE_PAGES | HASHMAP_NUMA_INTERLEAVE);
+    mu_assert_int_eq(1 << 19, q.number_nodes);
+    mu_assert_int_eq(HASHMAP_HUGE_PAGES | HASHMAP_NUMA_INTERLEAVE, q.alloc_flags);
+    for (uint64_t i = 0; i < q.number_nodes; ++i) {
+        mu_assert_null(q.nodes[i]);
+    }
+    hashmap_destroy(&q);
+}
+
+MU_TEST(test_cuckoo_setup) {
+    HashMap q;
+    hashmap_init_cuckoo(&q, 500, NULL);
+    mu_assert_int_eq(504, q.number_nodes);  // a whole number of buckets
+    mu_assert_int_eq(0, q.used_nodes);
+    mu_assert_int_eq(HASHMAP_CUCKOO, q.engine);
+    hashmap_destroy(&q);
+
+    hashmap_init_cuckoo(&q, 1, NULL);
+    mu_assert_int_eq(16, q.number_nodes);
+    hashmap_destroy(&q);
+}
+
 /*******************************************************************************
 *   Test Utility Setters
 *******************************************************************************/
@@ -98,6 +154,54 @@ MU_TEST(test_hashmap_set_alt) {
     mu_assert_string_eq(q, (char*)t);  // it gives you the old value back!
 }
 
+MU_TEST(test_hashmap_set_many) {
+    const int n = 5000;
+    char** keys = (char**)calloc(n + 1, sizeof(char*));
+    void** values = (void**)calloc(n + 1, sizeof(void*));
+    void** replaced = (void**)calloc(n + 1, sizeof(void*));
+    const char* vals[] = {"old", "new", "last"};
+    for (int i = 0; i < n; ++i) {
+        keys[i] = (char*)calloc(15, sizeof(char));
+        sprintf(keys[i], "%d", i);
+        values[i] = (void*)vals[1];
+    }
+    keys[n] = keys[7];  // repeated; the last value wins
+    values[n] = (void*)vals[2];
+    hashmap_set(&h, "3", (void*)vals[0]);
+
+    mu_assert_int_eq(n + 1, hashmap_set_many(&h, (const char* const*)keys, values, n + 1, replaced));
+    mu_assert_int_eq(n, h.used_nodes);
+    mu_assert_int_eq(32768, h.number_nodes);  // grown once, up front
+    mu_assert_string_eq("old", (char*)replaced[3]);
+    mu_assert_null(replaced[4]);
+    mu_assert_null(replaced[7]);
+    mu_assert_string_eq("new", (char*)replaced[n]);
+    mu_assert_string_eq("last", (char*)hashmap_get(&h, "7"));
+    for (int i = 0; i < n; ++i) {
+        if (i != 7) {
+            mu_assert_string_eq("new", (char*)hashmap_get(&h, keys[i]));
+        }
+    }
+
+    // a cache only keeps its capacity and a keyed map may re-seed along the way
+    HashMap cache, seeded;
+    const uint64_t seed[2] = {1, 2};
+    hashmap_init_cache(&cache, 100, NULL, NULL, NULL);
+    hashmap_init_seeded(&seeded, 64, NULL, seed);
+    mu_assert_int_eq(n, hashmap_set_many(&cache, (const char* const*)keys, values, n, NULL));
+    mu_assert_int_eq(100, cache.used_nodes);
+    mu_assert_int_eq(n, hashmap_set_many(&seeded, (const char* const*)keys, values, n, NULL));
+    for (int i = 0; i < n; ++i) {
+        mu_assert_string_eq("new", (char*)hashmap_get(&seeded, keys[i]));
+        free(keys[i]);
+    }
+    hashmap_destroy(&cache);
+    hashmap_destroy(&seeded);
+    free(keys);
+    free(values);
+    free(replaced);
+}
+
 
 /*******************************************************************************
 *   Test Getters
@@ -173,228 +277,2006 @@ MU_TEST(test_hashmap_get_not_found) {
 }
 
 /*******************************************************************************
-*   Test Removal
+*   Test Seeded Hashing
 *******************************************************************************/
-MU_TEST(test_hashmap_remove) {
+/* every key lands in the same cluster until the map picks a new seed */
+static uint64_t adversarial_hash(const char *key, const uint64_t seed[2]) {
+    return (seed[0] == 1 && seed[1] == 1) ? 7 : hashmap_siphash(key, seed);
+}
+
+MU_TEST(test_hashmap_siphash) {
+    // reference value for the empty message from the SipHash paper test vectors
+    const uint64_t seed[2] = {0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL};
+    mu_assert(hashmap_siphash("", seed) == 0x726fdb47dd0e0e31ULL, "Incorrect SipHash-2-4 value");
+
+    const uint64_t other[2] = {1, 2};
+    mu_assert(hashmap_siphash("key", seed) != hashmap_siphash("key", other), "Expected the seed to change the hash");
+}
+
+MU_TEST(test_hashmap_seeded) {
+    HashMap q;
+    hashmap_init_seeded(&q, 1024, NULL, NULL);
     for (int i = 0; i < 3000; ++i) {
         char key[15] = {0};
-        char* val = (char*)calloc(15, sizeof(char));
         sprintf(key, "%d", i);
-        sprintf(val, "%d-v", i);
-        hashmap_set(&h, key, val);
+        hashmap_set_int(&q, key, i);
     }
 
-    // test getting back what we expected
     int errors = 0;
-    for (int i = 0; i < 3000; i+=2) {
+    for (int i = 0; i < 3000; ++i) {
         char key[15] = {0};
-        char val[15] = {0};
         sprintf(key, "%d", i);
-        sprintf(val, "%d-v", i);
-        void* v = hashmap_remove(&h, key);
-        errors += (strcmp(val, (char*)v) == 0) ? 0 : 1;
-        free(v); // cleanup
+        int* v = (int*)hashmap_get(&q, key);
+        errors += (v != NULL && *v == i) ? 0 : 1;
     }
     mu_assert_int_eq(0, errors);
+    mu_assert_null(hashmap_get(&q, "3001"));
+    hashmap_destroy(&q);
+}
 
-    // test not present what was removed
-    errors = 0;
-    for (int i = 0; i < 3000; i+=2) {
+MU_TEST(test_hashmap_seeded_probe_guard) {
+    HashMap q;
+    const uint64_t seed[2] = {1, 1};
+    hashmap_init_seeded(&q, 1024, &adversarial_hash, seed);
+    for (int i = 0; i < 200; ++i) {
         char key[15] = {0};
         sprintf(key, "%d", i);
-        void* v = hashmap_remove(&h, key);
-        errors += (v == NULL) ? 0 : 1;
+        hashmap_set_int(&q, key, i);
     }
-    mu_assert_int_eq(0, errors);
+    mu_assert(q.seed[0] != 1 || q.seed[1] != 1, "Expected the map to be re-seeded");
 
-    // test present what was left
-    errors = 0;
-    for (int i = 1; i < 3000; i+=2) {
+    int errors = 0;
+    for (int i = 0; i < 200; ++i) {
         char key[15] = {0};
-        char val[15] = {0};
         sprintf(key, "%d", i);
-        sprintf(val, "%d-v", i);
-        void* v = hashmap_get(&h, key);
-        errors += (v != NULL && strcmp((char*)v, val) == 0) ? 0 : 1;
-        free(v); // cleanup
+        int* v = (int*)hashmap_get(&q, key);
+        errors += (v != NULL && *v == i) ? 0 : 1;
     }
     mu_assert_int_eq(0, errors);
+    mu_assert_int_eq(200, hashmap_number_keys(q));
+    hashmap_destroy(&q);
 }
 
-MU_TEST(test_hashmap_remove_mallocd) {
+/*******************************************************************************
+*   Test Interned Keys
+*******************************************************************************/
+MU_TEST(test_hashmap_interned) {
+    HashMap pool, a, b;
+    hashmap_init(&pool);
+    hashmap_init_interned(&a, 1024, NULL, &pool);
+    hashmap_init_interned(&b, 1024, NULL, &pool);
     for (int i = 0; i < 3000; ++i) {
         char key[15] = {0};
-        char* val = (char*)calloc(15, sizeof(char));
         sprintf(key, "%d", i);
-        sprintf(val, "%d-v", i);
-        hashmap_set_alt(&h, key, val);
+        hashmap_set_int(&a, key, i);
+        if (i % 2 == 0) {
+            hashmap_set_int(&b, key, -i);
+        }
     }
+    // each key is only stored once
+    mu_assert_int_eq(3000, hashmap_number_keys(pool));
 
-    // test getting back NULL since it will try to free it for us
+    char** keys = hashmap_keys(&b);
     int errors = 0;
-    for (int i = 0; i < 3000; i+=2) {
-        char key[15] = {0};
-        char val[15] = {0};
-        sprintf(key, "%d", i);
-        sprintf(val, "%d-v", i);
-        void* v = hashmap_remove(&h, key);
-        errors += (v == NULL) ? 0 : 1;
+    for (unsigned int i = 0; i < hashmap_number_keys(b); ++i) {
+        const char* interned = hashmap_intern(&pool, keys[i]);
+        errors += (interned != keys[i]) ? 0 : 1;
+        errors += (*(int*)hashmap_get(&a, interned) == -*(int*)hashmap_get(&b, interned)) ? 0 : 1;
+        errors += (hashmap_get(&b, interned) == hashmap_get(&b, keys[i])) ? 0 : 1;
+        hashmap_intern_release(&pool, interned);
+        free(keys[i]);
     }
+    free(keys);
     mu_assert_int_eq(0, errors);
 
-    // test not present what was removed
-    errors = 0;
-    for (int i = 0; i < 3000; i+=2) {
+    // the key goes away once neither map references it
+    hashmap_remove(&a, "2");
+    mu_assert_int_eq(3000, hashmap_number_keys(pool));
+    hashmap_remove(&b, "2");
+    mu_assert_int_eq(2999, hashmap_number_keys(pool));
+
+    hashmap_destroy(&a);
+    mu_assert_int_eq(1499, hashmap_number_keys(pool));
+    hashmap_destroy(&b);
+    mu_assert_int_eq(0, hashmap_number_keys(pool));
+    hashmap_destroy(&pool);
+}
+
+MU_TEST(test_hashmap_interned_resizing) {
+    HashMap pool;
+    char key[15] = {0};
+    hashmap_init_incremental(&pool, 1024, NULL);
+    for (int i = 0; i < 257; ++i) {  // the last one starts a resize
+        sprintf(key, "%d", i);
+        hashmap_intern(&pool, key);
+    }
+    mu_assert_not_null(pool.old_nodes);
+    for (int i = 0; i < 257; ++i) {  // most are released while still in the old array
+        sprintf(key, "%d", i);
+        hashmap_intern_release(&pool, key);
+    }
+    mu_assert_int_eq(0, hashmap_number_keys(pool));
+    hashmap_destroy(&pool);
+}
+
+MU_TEST(test_hashmap_interned_merge) {
+    HashMap pool, src;
+    hashmap_init(&pool);
+    hashmap_init_interned(&src, 1024, NULL, &pool);
+    hashmap_set_int(&src, "a", 1);
+    hashmap_set_int(&src, "b", 2);
+    hashmap_set_int(&h, "b", 3);
+
+    // the keys move out of the pool into private copies
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_merge(&h, &src, NULL, NULL));
+    mu_assert_int_eq(0, hashmap_number_keys(pool));
+    mu_assert_int_eq(1, *(int*)hashmap_get(&h, "a"));
+    mu_assert_int_eq(3, *(int*)hashmap_get(&h, "b"));
+    hashmap_destroy(&src);
+    hashmap_destroy(&pool);
+}
+
+/*******************************************************************************
+*   Test Allocation Flags
+*******************************************************************************/
+MU_TEST(test_hashmap_huge_pages) {
+    // starts below the mmap threshold and grows past it
+    HashMap q;
+    hashmap_init_with_flags(&q, 1024, NULL, HASHMAP_HUGE_PAGES | HASHMAP_NUMA_INTERLEAVE);
+    for (int i = 0; i < 100000; ++i) {
         char key[15] = {0};
         sprintf(key, "%d", i);
-        void* v = hashmap_remove(&h, key);
-        errors += (v == NULL) ? 0 : 1;
+        hashmap_set_int(&q, key, i);
+    }
+    for (int i = 0; i < 100000; i += 2) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        hashmap_remove(&q, key);
     }
-    mu_assert_int_eq(0, errors);
 
-    // test present what was left
-    errors = 0;
-    for (int i = 1; i < 3000; i+=2) {
+    int errors = 0;
+    for (int i = 0; i < 100000; ++i) {
         char key[15] = {0};
-        char val[15] = {0};
         sprintf(key, "%d", i);
-        sprintf(val, "%d-v", i);
-        void* v = hashmap_get(&h, key);
-        errors += (v != NULL && strcmp((char*)v, val) == 0) ? 0 : 1;
+        int* v = (int*)hashmap_get(&q, key);
+        if (i % 2 == 0) {
+            errors += (v == NULL) ? 0 : 1;
+        } else {
+            errors += (v != NULL && *v == i) ? 0 : 1;
+        }
     }
     mu_assert_int_eq(0, errors);
+    mu_assert_int_eq(1, q.buckets_mapped);
+    hashmap_destroy(&q);
 }
 
 /*******************************************************************************
-*   Test Keys
+*   Test Cache Mode
 *******************************************************************************/
-MU_TEST(test_hashmap_keys) {
-    // add some values
-    for (int i = 0; i < 3000; ++i) {
+static void count_evicted(const char *key, void *value, void *ctx) {
+    (void)key;
+    (void)value;
+    ++*(int*)ctx;
+}
+
+MU_TEST(test_hashmap_cache) {
+    HashMap q;
+    int evicted = 0;
+    mu_assert_int_eq(HASHMAP_FAILURE, hashmap_init_cache(&q, 0, NULL, NULL, NULL));
+    hashmap_init_cache(&q, 100, NULL, &count_evicted, &evicted);
+    uint64_t num_nodes = q.number_nodes;
+    for (int i = 0; i < 100; ++i) {
         char key[15] = {0};
-        char* val = (char*)calloc(15, sizeof(char));
         sprintf(key, "%d", i);
-        sprintf(val, "%d-v", i);
-        hashmap_set(&h, key, val);
+        hashmap_set_int(&q, key, i);
     }
+    mu_assert_int_eq(0, evicted);
+    mu_assert_int_eq(100, q.used_nodes);
+
+    // recently used keys get a second chance
+    for (int i = 0; i < 50; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        hashmap_get(&q, key);
+    }
+    for (int i = 100; i < 110; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        hashmap_set_int(&q, key, i);
+    }
+    mu_assert_int_eq(10, evicted);
+    mu_assert_int_eq(100, q.used_nodes);
+    mu_assert_int_eq(num_nodes, q.number_nodes);  // never resized
 
-    char** keys = hashmap_keys(&h);
-    // make some tests
     int errors = 0;
-    unsigned s = hashmap_number_keys(h);
-    for (unsigned int i = 0; i < s; ++i) {
-        void* val = hashmap_get(&h, keys[i]);
-        int key_i = atoi(keys[i]);
-        char val_c[15] = {0};
-        sprintf(val_c, "%d-v", key_i);
-        errors += (val != NULL && strcmp((char*)val, val_c) == 0) ? 0 : 1;
-        free(val);
+    for (int i = 0; i < 50; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        int* v = (int*)hashmap_get(&q, key);
+        errors += (v != NULL && *v == i) ? 0 : 1;
     }
     mu_assert_int_eq(0, errors);
 
-    // free the data
-    for (unsigned int i = 0; i < hashmap_number_keys(h); ++i) {
-        free(keys[i]);
-    }
-    free(keys);
+    // updating a present key does not evict
+    hashmap_set_int(&q, "0", 1000);
+    mu_assert_int_eq(10, evicted);
+    mu_assert_int_eq(1000, *(int*)hashmap_get(&q, "0"));
 
+    for (int i = 0; i < 1000; ++i) {
+        char key[15] = {0};
+        sprintf(key, "new%d", i);
+        hashmap_set_int(&q, key, i);
+    }
+    mu_assert_int_eq(1010, evicted);
+    mu_assert_int_eq(100, q.used_nodes);
+    mu_assert_int_eq(999, *(int*)hashmap_get(&q, "new999"));
+    hashmap_destroy(&q);
 }
 
 /*******************************************************************************
-*   Test Statistics
+*   Test Expiry
 *******************************************************************************/
-MU_TEST(test_hashmap_stat) {
-    for (int i = 0; i < 55000; ++i) {
-        char key[15] = {0};
-        char val[15] = {0};
-        sprintf(key, "%d", i);
-        sprintf(val, "%d-v", i);
-        hashmap_set(&h, key, val);
-    }
+static uint64_t fake_now = 0;
 
-    /* save the printout to a buffer */
-    int stdout_save;
-    char buffer[2046] = {0};
-    fflush(stdout); //clean everything first
-    stdout_save = dup(STDOUT_FILENO); //save the stdout state
-    freopen("output_file", "a", stdout); //redirect stdout to null pointer
-    setvbuf(stdout, buffer, _IOFBF, 1024); //set buffer to stdout
+static uint64_t fake_clock(void) {
+    return fake_now;
+}
 
-    hashmap_stats(&h);
+MU_TEST(test_hashmap_set_ttl) {
+    int expired = 0;
+    fake_now = 100;
+    hashmap_set_expiry(&h, &fake_clock, &count_evicted, &expired);
+    hashmap_set_ttl(&h, "a", (void*)"a", 150);
+    hashmap_set_ttl(&h, "b", (void*)"b", 200);
+    hashmap_set(&h, "c", (void*)"c");
+    mu_assert_string_eq("a", (char*)hashmap_get(&h, "a"));
 
-    /* reset stdout */
-    freopen("output_file", "a", stdout); //redirect stdout to null again
-    dup2(stdout_save, STDOUT_FILENO); //restore the previous state of stdout
-    setvbuf(stdout, NULL, _IONBF, 0); //disable buffer to print to screen instantly
+    fake_now = 150;
+    mu_assert_null(hashmap_get(&h, "a"));  // expired, but a get does not free it
+    mu_assert_int_eq(0, expired);
+    mu_assert_int_eq(3, h.used_nodes);
+    mu_assert_null(hashmap_remove(&h, "a"));  // reclaimed by the remove
+    mu_assert_int_eq(1, expired);
+    mu_assert_int_eq(2, h.used_nodes);
+    mu_assert_string_eq("b", (char*)hashmap_get(&h, "b"));
 
-    // Not sure this is necessary, but it cleans it up
-    remove("output_file");
+    // setting without an expiry clears it; a ttl can be added to any key
+    hashmap_set(&h, "b", (void*)"b2");
+    hashmap_set_ttl(&h, "c", (void*)"c2", 300);
+    fake_now = 1000;
+    mu_assert_string_eq("b2", (char*)hashmap_get(&h, "b"));
+    mu_assert_null(hashmap_get(&h, "c"));
+    mu_assert_int_eq(1, expired);
+    mu_assert_int_eq(1, hashmap_expire_step(&h, h.number_nodes));
+    mu_assert_int_eq(2, expired);
 
-    mu_assert_not_null(buffer);
-    mu_assert_string_eq("HashMap:\n\
-    Number Nodes: 262144\n\
-    Used Nodes: 55000\n\
-    Fullness: 20.980835%\n\
-    Average O(n): 1.041344\n\
-    Average Used O(n): 1.197055\n\
-    Max O(n): 9\n\
-    Max Consecutive Buckets Used: 11\n\
-    Number Hash Collisions: 0\n\
-    Number Index Collisions: 7656\n\
-    Size on disk (bytes): 3857184\n", buffer);
+    // re-inserting an expired key replaces it
+    hashmap_set_ttl(&h, "d", (void*)"d", 1001);
+    fake_now = 2000;
+    mu_assert_int_eq(1, *hashmap_increment(&h, "d", 1));
+    mu_assert_int_eq(3, expired);
+    hashmap_set_expiry(&h, NULL, NULL, NULL);
 }
 
-MU_TEST(test_hashmap_fullness) {
-    /* on empty */
-    mu_assert_double_eq(0.0, hashmap_get_fullness(&h));
+MU_TEST(test_hashmap_set_ttl_slot) {
+    int inserted;
+    fake_now = 100;
+    hashmap_set_expiry(&h, &fake_clock, NULL, NULL);
+    void** slot = hashmap_get_or_insert(&h, "a", &inserted);
+    *slot = (void*)"a";
+    hashmap_set_ttl(&h, "a", (void*)"a2", 200);  // the node is not moved
+    mu_assert_string_eq("a2", (char*)*slot);
+    *slot = (void*)"a3";
+    mu_assert_string_eq("a3", (char*)hashmap_get(&h, "a"));
+    fake_now = 200;
+    mu_assert_null(hashmap_get(&h, "a"));
+    hashmap_set_expiry(&h, NULL, NULL, NULL);
+}
 
-    for (int i = 0; i < 3000; ++i) {
+MU_TEST(test_hashmap_expire_step) {
+    int expired = 0;
+    fake_now = 0;
+    hashmap_set_expiry(&h, &fake_clock, &count_evicted, &expired);
+    for (int i = 0; i < 5000; ++i) {
         char key[15] = {0};
-        char val[15] = {0};
         sprintf(key, "%d", i);
-        sprintf(val, "%d-v", i);
-        hashmap_set(&h, key, val);
+        hashmap_set_ttl(&h, key, (void*)"v", (i % 2 == 0) ? 10 : 20);
     }
+    fake_now = 10;
+    uint64_t removed = 0, steps = 0;
+    while (removed < 2500) {
+        uint64_t r = hashmap_expire_step(&h, 1000);
+        mu_assert(r <= 1000, "Expected no more keys than buckets examined");
+        removed += r;
+        ++steps;
+    }
+    mu_assert_int_eq(2500, removed);
+    mu_assert_int_eq(2500, expired);
+    mu_assert(steps <= (h.number_nodes + 2500) / 1000 + 1, "Expected a single pass over the buckets");
+    mu_assert_int_eq(2500, h.used_nodes);
+    mu_assert_int_eq(0, hashmap_expire_step(&h, h.number_nodes));
 
-    mu_assert_double_eq(18.310546875, hashmap_get_fullness(&h));
+    int errors = 0;
+    for (int i = 0; i < 5000; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        errors += ((hashmap_get(&h, key) != NULL) == (i % 2 == 1)) ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+    hashmap_set_expiry(&h, NULL, NULL, NULL);
 }
 
 /*******************************************************************************
-*   Testsuite
+*   Test Frozen Maps
 *******************************************************************************/
-MU_TEST_SUITE(test_suite) {
-    MU_SUITE_CONFIGURE(&test_setup, &test_teardown);
+MU_TEST(test_hashmap_freeze) {
+    for (int i = 0; i < 50000; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        hashmap_set_int(&h, key, i);
+    }
+    hashmap_set(&h, "user", (void*)"owned by the caller");
 
-    /* setup */
-    MU_RUN_TEST(test_default_setup);
-    MU_RUN_TEST(test_non_default_setup);
+    HashMapFrozen f;
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_freeze(&h, &f));
+    mu_assert_int_eq(50001, f.number_keys);
+    mu_assert_int_eq(0, h.used_nodes);
+    mu_assert_null(hashmap_get(&h, "100"));
 
-    /* utility setters */
-    MU_RUN_TEST(test_hashmap_set_int);
-    MU_RUN_TEST(test_hashmap_set_long);
-    MU_RUN_TEST(test_hashmap_set_float);
-    MU_RUN_TEST(test_hashmap_set_double);
-    MU_RUN_TEST(test_hashmap_set_string);
+    int errors = 0;
+    for (int i = 0; i < 50000; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        int* v = (int*)hashmap_frozen_get(&f, key);
+        errors += (v != NULL && *v == i) ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+    mu_assert_string_eq("owned by the caller", (char*)hashmap_frozen_get(&f, "user"));
+    mu_assert_null(hashmap_frozen_get(&f, "50000"));
+    mu_assert_null(hashmap_frozen_get(&f, "-1"));
+    hashmap_frozen_destroy(&f);
 
-    /* setters */
-    MU_RUN_TEST(test_hashmap_set);
-    MU_RUN_TEST(test_hashmap_set_alt);
+    // an empty map freezes too
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_freeze(&h, &f));
+    mu_assert_int_eq(0, f.number_keys);
+    mu_assert_null(hashmap_frozen_get(&f, "0"));
+    hashmap_frozen_destroy(&f);
+}
 
-    /* getters */
-    MU_RUN_TEST(test_hashmap_get);
-    MU_RUN_TEST(test_hashmap_get_changed);
-    MU_RUN_TEST(test_hashmap_get_not_found);
+/*******************************************************************************
+*   Test Compact Maps
+*******************************************************************************/
+static void append_key(const char *key, void *value, void *ctx) {
+    (void)value;
+    strcat((char*)ctx, key);
+}
 
-    /* remove */
-    MU_RUN_TEST(test_hashmap_remove);
-    MU_RUN_TEST(test_hashmap_remove_mallocd);
+MU_TEST(test_hashmap_compact) {
+    HashMapCompact c;
+    char key[15] = {0}, order[64] = {0};
+    const char* vals[] = {"v0", "v1", "v2", "v3"};
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_compact_init(&c, 0, NULL));
+    mu_assert_int_eq(8, c.number_slots);
+    mu_assert_int_eq(1, c.index_width);
 
-    /* keys */
-    MU_RUN_TEST(test_hashmap_keys);
+    hashmap_compact_set(&c, "d", (void*)vals[0]);
+    hashmap_compact_set(&c, "a", (void*)vals[1]);
+    hashmap_compact_set(&c, "c", (void*)vals[2]);
+    mu_assert_string_eq("v0", (char*)hashmap_compact_set(&c, "d", (void*)vals[3]));  // keeps its place
+    mu_assert_string_eq("v1", (char*)hashmap_compact_remove(&c, "a"));
+    mu_assert_null(hashmap_compact_remove(&c, "a"));
+    hashmap_compact_set(&c, "a", (void*)vals[1]);  // re-added at the end
+    hashmap_compact_set(&c, "b", (void*)vals[2]);  // the entries are full; the removed one is dropped
+    mu_assert_int_eq(4, c.used_nodes);
+    mu_assert_int_eq(16, c.number_slots);
+    hashmap_compact_for_each(&c, append_key, order);
+    mu_assert_string_eq("dcab", order);
+    mu_assert_string_eq("v3", (char*)hashmap_compact_get(&c, "d"));
+    mu_assert_null(hashmap_compact_get(&c, "e"));
+
+    for (int i = 0; i < 100000; ++i) {  // widens the index to 2 then 4 bytes
+        sprintf(key, "%d", i);
+        hashmap_compact_set(&c, key, (void*)vals[i % 4]);
+    }
+    mu_assert_int_eq(4, c.index_width);
+    for (int i = 0; i < 100000; i += 2) {
+        sprintf(key, "%d", i);
+        mu_assert_string_eq(vals[i % 4], (char*)hashmap_compact_remove(&c, key));
+    }
+    for (int i = 0; i < 100000; ++i) {
+        sprintf(key, "%d", i);
+        if (i % 2 == 0) {
+            mu_assert_null(hashmap_compact_get(&c, key));
+        } else {
+            mu_assert_string_eq(vals[i % 4], (char*)hashmap_compact_get(&c, key));
+        }
+    }
+    char** keys = hashmap_compact_keys(&c);
+    mu_assert_string_eq("d", keys[0]);
+    mu_assert_string_eq("b", keys[3]);
+    mu_assert_string_eq("1", keys[4]);
+    mu_assert_string_eq("99999", keys[c.used_nodes - 1]);
+    for (uint64_t i = 0; i < c.used_nodes; ++i) {
+        free(keys[i]);
+    }
+    free(keys);
+    hashmap_compact_destroy(&c);
+}
+
+/*******************************************************************************
+*   Test Fingerprint Tags
+*******************************************************************************/
+MU_TEST(test_hashmap_tags) {
+    // tags follow their nodes through growth, removal and compaction
+    for (int i = 0; i < 5000; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        hashmap_set_int(&h, key, i);
+    }
+    const char* keys[] = {"0", "10", "20", "30", "40"};
+    hashmap_remove_many(&h, keys, 5, NULL);
+    for (int i = 1; i < 5000; i += 3) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        hashmap_remove(&h, key);
+    }
+    int errors = 0;
+    for (uint64_t i = 0; i < h.number_nodes; ++i) {
+        if (h.nodes[i] != NULL && h.tags[i] != (uint8_t)(h.nodes[i]->hash >> 56)) {
+            ++errors;
+        }
+    }
+    mu_assert_int_eq(0, errors);
+    mu_assert_int_eq(2499, *(int*)hashmap_get(&h, "2499"));
+    mu_assert_null(hashmap_get(&h, "2500"));
+}
+
+/*******************************************************************************
+*   Test Bloom Filter
+*******************************************************************************/
+MU_TEST(test_hashmap_bloom) {
+    char key[15] = {0};
+    for (int i = 0; i < 100; ++i) {  // keys present before it is enabled are added
+        sprintf(key, "%d", i);
+        hashmap_set_int(&h, key, i);
+    }
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_enable_bloom(&h));
+    mu_assert_int_eq(1024 / 4 / 32 + 1, h.bloom_blocks);
+    mu_assert_int_eq(0, (uintptr_t)h.bloom % 64);
+    for (int i = 100; i < 3000; ++i) {  // grows the table, and the filter with it
+        sprintf(key, "%d", i);
+        hashmap_set_int(&h, key, i);
+    }
+    mu_assert_int_eq(16384 / 4 / 32 + 1, h.bloom_blocks);
+    int misses = 0;
+    for (int i = 0; i < 6000; ++i) {
+        sprintf(key, "%d", i);
+        int *v = (int*)hashmap_get(&h, key);
+        if (i < 3000) {
+            mu_assert_int_eq(i, *v);
+        } else {
+            misses += (v == NULL);
+        }
+    }
+    mu_assert_int_eq(3000, misses);
+
+    // removed keys stay in the filter until it is rebuilt
+    for (int i = 0; i < 2000; ++i) {
+        sprintf(key, "%d", i);
+        hashmap_remove(&h, key);
+    }
+    mu_assert_int_eq(2000, h.bloom_removed);
+    const char* keys[] = {"2000", "2001", "2002", "2003", "2004", "2005", "2006", "2007"};
+    hashmap_remove_many(&h, keys, 8, NULL);
+    mu_assert_int_eq(2008, h.bloom_removed);
+    for (int i = 2008; i < 2100; ++i) {  // rebuilt at the 2048th removal, one per 8 buckets
+        sprintf(key, "%d", i);
+        hashmap_remove(&h, key);
+    }
+    mu_assert_int_eq(52, h.bloom_removed);
+    for (int i = 0; i < 3000; ++i) {
+        sprintf(key, "%d", i);
+        int *v = (int*)hashmap_get(&h, key);
+        if (i < 2100) {
+            mu_assert_null(v);
+        } else {
+            mu_assert_int_eq(i, *v);
+        }
+    }
+
+    HashMap other;
+    hashmap_init(&other);
+    hashmap_set_int(&other, "merged", 1);
+    hashmap_merge(&h, &other, NULL, NULL);
+    hashmap_destroy(&other);
+    mu_assert_int_eq(1, *(int*)hashmap_get(&h, "merged"));
+
+    hashmap_disable_bloom(&h);
+    mu_assert_null(h.bloom);
+    mu_assert_int_eq(2100, *(int*)hashmap_get(&h, "2100"));
+}
+
+MU_TEST(test_hashmap_bloom_incremental) {
+    HashMap inc;
+    char key[15] = {0};
+    hashmap_init_incremental(&inc, 1024, NULL);
+    hashmap_enable_bloom(&inc);
+    int filling = 0, missing = 0;
+    for (int i = 0; i < 50000; ++i) {
+        sprintf(key, "%d", i);
+        hashmap_set_int(&inc, key, i);
+        if (inc.old_nodes != NULL) {  // the filter for the new size is filled as the keys move
+            filling += (inc.bloom_next != NULL && inc.bloom_next_blocks == inc.number_nodes / 4 / 32 + 1) ? 1 : 0;
+            sprintf(key, "%d", i / 2);
+            missing += (hashmap_get(&inc, key) == NULL) ? 1 : 0;
+        }
+    }
+    mu_assert(filling > 0, "Expected a filter for the new size while resizing");
+    mu_assert_int_eq(0, missing);
+    hashmap_resize_step(&inc, UINT64_MAX);
+    mu_assert_null(inc.bloom_next);
+    mu_assert_int_eq(262144 / 4 / 32 + 1, inc.bloom_blocks);  // swapped in once the last resize finished
+
+    // a saturated filter would have nearly every bit set and reject nothing
+    uint64_t bits = 0;
+    for (uint64_t i = 0; i < inc.bloom_blocks * 8; ++i) {
+        for (uint64_t w = inc.bloom[i]; w != 0; w &= w - 1) {
+            ++bits;
+        }
+    }
+    mu_assert(bits < inc.bloom_blocks * 512 / 2, "Expected most of the filter's bits to be clear");
+    int misses = 0;
+    for (int i = 0; i < 100000; ++i) {
+        sprintf(key, "%d", i);
+        int *v = (int*)hashmap_get(&inc, key);
+        if (i < 50000) {
+            mu_assert_int_eq(i, *v);
+        } else {
+            misses += (v == NULL);
+        }
+    }
+    mu_assert_int_eq(50000, misses);
+    hashmap_destroy(&inc);
+}
+
+MU_TEST(test_hashmap_bloom_cuckoo) {
+    HashMap c;
+    char key[15] = {0};
+    hashmap_init_cuckoo(&c, 64, NULL);
+    hashmap_enable_bloom(&c);
+    for (int i = 0; i < 5000; ++i) {
+        sprintf(key, "%d", i);
+        hashmap_set_int(&c, key, i);
+    }
+    for (int i = 0; i < 10000; ++i) {
+        sprintf(key, "%d", i);
+        int *v = (int*)hashmap_get(&c, key);
+        if (i < 5000) {
+            mu_assert_int_eq(i, *v);
+        } else {
+            mu_assert_null(v);
+        }
+    }
+    hashmap_destroy(&c);
+}
+
+/*******************************************************************************
+*   Test Incremental Resize
+*******************************************************************************/
+MU_TEST(test_hashmap_incremental) {
+    HashMap q;
+    hashmap_init_incremental(&q, 1024, NULL);
+    mu_assert_int_eq(0, hashmap_resize_step(&q, 10));
+
+    int errors = 0, resizing = 0;
+    for (int i = 0; i < 100000; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        hashmap_set_int(&q, key, i);
+        resizing += (q.old_nodes != NULL) ? 1 : 0;
+        // every key, old or new, can be found while a resize is in progress
+        sprintf(key, "%d", (i + 1) / 2);
+        int *v = (int*)hashmap_get(&q, key);
+        errors += (v != NULL && *v == (i + 1) / 2) ? 0 : 1;
+        if (i % 3 == 0) {
+            sprintf(key, "%d", i / 3);
+            hashmap_remove(&q, key);
+        }
+    }
+    mu_assert_int_eq(0, errors);
+    mu_assert(resizing > 0, "Expected inserts during a resize");
+    mu_assert_int_eq(100000 - 33334, q.used_nodes);
+
+    // start another resize and check the reads that span both arrays
+    while (q.old_nodes == NULL) {
+        char key[15] = {0};
+        sprintf(key, "x%d", (int)q.used_nodes);
+        hashmap_set_int(&q, key, 0);
+    }
+    uint64_t num_keys = q.used_nodes, visited = 0, migrated = q.migrated;
+    char** keys = hashmap_keys(&q);
+    for (uint64_t i = 0; i < num_keys; ++i) {
+        visited += (hashmap_get(&q, keys[i]) != NULL) ? 1 : 0;
+        free(keys[i]);
+    }
+    free(keys);
+    mu_assert_int_eq(num_keys, visited);
+    mu_assert_int_eq(migrated, q.migrated);  // lookups are read only
+    mu_assert(q.old_nodes != NULL, "Expected lookups to leave the resize to writers");
+
+    while (hashmap_resize_step(&q, 100) != 0) { }
+    mu_assert_null(q.old_nodes);
+    mu_assert_int_eq(99999, *(int*)hashmap_get(&q, "99999"));
+    mu_assert_null(hashmap_get(&q, "3"));
+    mu_assert_int_eq(num_keys, q.used_nodes);
+    hashmap_destroy(&q);
+}
+
+/*******************************************************************************
+*   Test Cuckoo Engine
+*******************************************************************************/
+static int cuckoo_is_odd(const char *key, void *value, void *ctx) {
+    (void)key;
+    (void)ctx;
+    return *(int*)value % 2;
+}
+
+MU_TEST(test_hashmap_cuckoo) {
+    HashMap q, r;
+    hashmap_init_cuckoo(&q, 16, NULL);
+    for (int i = 0; i < 100000; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        hashmap_set_int(&q, key, i);
+    }
+    mu_assert_int_eq(100000, q.used_nodes);
+    mu_assert(hashmap_get_fullness(&q) > 25.0, "Expected the cuckoo table to fill past the linear probing limit");
+
+    for (int i = 0; i < 100000; i += 2) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        hashmap_remove(&q, key);
+    }
+
+    // merge back in every fourth key from a linear probing map
+    hashmap_init(&r);
+    for (int i = 0; i < 100000; i += 4) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        hashmap_set_int(&r, key, i);
+    }
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_merge(&q, &r, NULL, NULL));
+    hashmap_destroy(&r);
+
+    int errors = 0;
+    for (int i = 0; i < 100000; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        int* v = (int*)hashmap_get(&q, key);
+        if (i % 4 == 2) {
+            errors += (v == NULL) ? 0 : 1;
+        } else {
+            errors += (v != NULL && *v == i) ? 0 : 1;
+        }
+    }
+    mu_assert_int_eq(0, errors);
+    mu_assert_int_eq(75000, q.used_nodes);
+
+    mu_assert_int_eq(50000, hashmap_remove_if(&q, cuckoo_is_odd, NULL));
+    mu_assert_int_eq(25000, q.used_nodes);
+    mu_assert_not_null(hashmap_get(&q, "99996"));
+    mu_assert_null(hashmap_get(&q, "99999"));
+    hashmap_destroy(&q);
+}
+
+/*******************************************************************************
+*   Test Allocator
+*******************************************************************************/
+/* counts the live allocations in ctx */
+static void* counting_malloc(size_t size, void *ctx) {
+    ++*(long*)ctx;
+    return malloc(size);
+}
+
+static void* counting_calloc(size_t num, size_t size, void *ctx) {
+    ++*(long*)ctx;
+    return calloc(num, size);
+}
+
+static void* counting_realloc(void *ptr, size_t size, void *ctx) {
+    if (ptr == NULL) {
+        ++*(long*)ctx;
+    }
+    return realloc(ptr, size);
+}
+
+static void counting_free(void *ptr, void *ctx) {
+    if (ptr != NULL) {
+        --*(long*)ctx;
+    }
+    free(ptr);
+}
+
+/* counts like the above, but fails every allocation once `budget` were made */
+typedef struct limited_allocations {
+    long live;
+    long budget;
+} limited_allocations;
+
+static void* limited_malloc(size_t size, void *ctx) {
+    limited_allocations *a = (limited_allocations*)ctx;
+    if (a->budget == 0) {return NULL;}
+    --a->budget;
+    return counting_malloc(size, &a->live);
+}
+
+static void* limited_calloc(size_t num, size_t size, void *ctx) {
+    limited_allocations *a = (limited_allocations*)ctx;
+    if (a->budget == 0) {return NULL;}
+    --a->budget;
+    return counting_calloc(num, size, &a->live);
+}
+
+static void* limited_realloc(void *ptr, size_t size, void *ctx) {
+    limited_allocations *a = (limited_allocations*)ctx;
+    if (a->budget == 0) {return NULL;}
+    --a->budget;
+    return counting_realloc(ptr, size, &a->live);
+}
+
+static void limited_free(void *ptr, void *ctx) {
+    counting_free(ptr, &((limited_allocations*)ctx)->live);
+}
+
+MU_TEST(test_hashmap_allocator) {
+    long live = 0;
+    hashmap_allocator allocator = {&counting_malloc, &counting_calloc, &counting_realloc, &counting_free, &live};
+    HashMap q;
+    hashmap_init_with_allocator(&q, 1024, NULL, &allocator);
+    mu_assert_int_eq(2, live);  // the bucket and tag arrays
+
+    for (int i = 0; i < 3000; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        hashmap_set_int(&q, key, i);
+    }
+    mu_assert_int_eq(2 + 3 * 3000, live);  // node, key and value for each
+
+    char* v = (char*)allocator.malloc_fn(15, allocator.ctx);
+    sprintf(v, "value");
+    hashmap_set_alt(&q, "alt", v);
+    hashmap_set(&q, "user", v);
+    mu_assert_int_eq(2 + 3 * 3000 + 5, live);
+
+    for (int i = 0; i < 3000; i += 2) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        hashmap_remove(&q, key);
+    }
+    mu_assert_int_eq(2 + 3 * 1500 + 5, live);
+    mu_assert_int_eq(1499, *(int*)hashmap_get(&q, "1499"));
+
+    // nodes can only move between maps sharing an allocator
+    mu_assert_int_eq(HASHMAP_FAILURE, hashmap_merge(&h, &q, NULL, NULL));
+
+    hashmap_destroy(&q);
+    mu_assert_int_eq(0, live);
+}
+
+/*******************************************************************************
+*   Test Get or Insert
+*******************************************************************************/
+MU_TEST(test_hashmap_get_or_insert) {
+    int inserted = 0;
+    char v[] = "this is a test";
+    void** slot = hashmap_get_or_insert(&h, "test", &inserted);
+    mu_assert_int_eq(1, inserted);
+    mu_assert_null(*slot);
+    mu_assert_int_eq(1, hashmap_number_keys(h));
+    *slot = v;
+
+    slot = hashmap_get_or_insert(&h, "test", &inserted);
+    mu_assert_int_eq(0, inserted);
+    mu_assert_string_eq(v, (char*)*slot);
+    mu_assert_string_eq(v, (char*)hashmap_get(&h, "test"));
+    mu_assert_int_eq(1, hashmap_number_keys(h));
+
+    // a NULL value is still present and can be removed
+    mu_assert_not_null(hashmap_get_or_insert(&h, "null", NULL));
+    mu_assert_int_eq(2, hashmap_number_keys(h));
+    hashmap_remove(&h, "null");
+    mu_assert_int_eq(1, hashmap_number_keys(h));
+}
+
+MU_TEST(test_hashmap_increment) {
+    for (int i = 0; i < 3000; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i % 100);
+        hashmap_increment(&h, key, 2);
+    }
+    mu_assert_int_eq(100, hashmap_number_keys(h));
+
+    int errors = 0;
+    for (int i = 0; i < 100; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        int* v = (int*)hashmap_get(&h, key);
+        errors += (v != NULL && *v == 60) ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+
+    hashmap_set_int(&h, "100", 5);
+    int* t = hashmap_increment(&h, "100", -10);
+    mu_assert_int_eq(-5, *t);
+}
+
+MU_TEST(test_hashmap_increment_no_memory) {
+    limited_allocations allocs = {0, 1000};
+    hashmap_allocator allocator = {&limited_malloc, &limited_calloc, &limited_realloc, &limited_free, &allocs};
+    HashMap q;
+    hashmap_init_with_allocator(&q, 1024, NULL, &allocator);
+    mu_assert_int_eq(3, *hashmap_increment(&q, "a", 3));
+
+    allocs.budget = 2;  // the node and key, but not the int
+    mu_assert_null(hashmap_increment(&q, "b", 3));
+    mu_assert_int_eq(1, q.used_nodes);
+    mu_assert_null(hashmap_get(&q, "b"));
+    mu_assert_int_eq(4, *hashmap_increment(&q, "a", 1));  // existing keys need no memory
+
+    hashmap_destroy(&q);
+    mu_assert_int_eq(0, allocs.live);
+}
+
+/*******************************************************************************
+*   Test Multimap
+*******************************************************************************/
+MU_TEST(test_hashmap_multi) {
+    const char* docs[] = {"doc0", "doc1", "doc2", "doc3", "doc4", "doc5", "doc6", "doc7", "doc8", "doc9"};
+    uint64_t count = 5;
+    mu_assert_null(hashmap_multi_get(&h, "word", &count));
+    mu_assert_int_eq(0, count);
+
+    for (int i = 0; i < 10; ++i) {  // grows past the initial block
+        mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_multi_add(&h, "word", (void*)docs[i]));
+    }
+    hashmap_multi_add(&h, "other", (void*)docs[3]);
+    mu_assert_int_eq(2, h.used_nodes);
+
+    void** values = hashmap_multi_get(&h, "word", &count);
+    mu_assert_int_eq(10, count);
+    for (int i = 0; i < 10; ++i) {
+        mu_assert_string_eq(docs[i], (char*)values[i]);
+    }
+
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_multi_remove_value(&h, "word", docs[3]));
+    mu_assert_int_eq(HASHMAP_FAILURE, hashmap_multi_remove_value(&h, "word", docs[3]));
+    mu_assert_int_eq(HASHMAP_FAILURE, hashmap_multi_remove_value(&h, "none", docs[3]));
+    values = hashmap_multi_get(&h, "word", &count);
+    mu_assert_int_eq(9, count);
+    mu_assert_string_eq("doc2", (char*)values[2]);
+    mu_assert_string_eq("doc4", (char*)values[3]);
+
+    // the last value removes the key
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_multi_remove_value(&h, "other", docs[3]));
+    mu_assert_null(hashmap_multi_get(&h, "other", &count));
+    mu_assert_int_eq(1, h.used_nodes);
+
+    hashmap_set(&h, "single", (void*)docs[0]);
+    mu_assert_int_eq(HASHMAP_FAILURE, hashmap_multi_add(&h, "single", (void*)docs[1]));
+
+    // owned single values are not multimap blocks either
+    hashmap_set_int(&h, "int", 5);
+    hashmap_set_string(&h, "string", "value");
+    mu_assert_int_eq(HASHMAP_FAILURE, hashmap_multi_add(&h, "int", (void*)docs[1]));
+    mu_assert_int_eq(HASHMAP_FAILURE, hashmap_multi_add(&h, "string", (void*)docs[1]));
+    mu_assert_null(hashmap_multi_get(&h, "int", &count));
+    mu_assert_int_eq(0, count);
+    mu_assert_int_eq(HASHMAP_FAILURE, hashmap_multi_remove_value(&h, "int", docs[1]));
+    mu_assert_int_eq(5, *(int*)hashmap_get(&h, "int"));
+
+    // replacing a multimap key with a single value ends it being one
+    hashmap_set_int(&h, "word", 7);
+    mu_assert_null(hashmap_multi_get(&h, "word", &count));
+    mu_assert_int_eq(HASHMAP_FAILURE, hashmap_multi_add(&h, "word", (void*)docs[1]));
+}
+
+/*******************************************************************************
+*   Test Removal
+*******************************************************************************/
+MU_TEST(test_hashmap_remove) {
+    for (int i = 0; i < 3000; ++i) {
+        char key[15] = {0};
+        char* val = (char*)calloc(15, sizeof(char));
+        sprintf(key, "%d", i);
+        sprintf(val, "%d-v", i);
+        hashmap_set(&h, key, val);
+    }
+
+    // test getting back what we expected
+    int errors = 0;
+    for (int i = 0; i < 3000; i+=2) {
+        char key[15] = {0};
+        char val[15] = {0};
+        sprintf(key, "%d", i);
+        sprintf(val, "%d-v", i);
+        void* v = hashmap_remove(&h, key);
+        errors += (strcmp(val, (char*)v) == 0) ? 0 : 1;
+        free(v); // cleanup
+    }
+    mu_assert_int_eq(0, errors);
+
+    // test not present what was removed
+    errors = 0;
+    for (int i = 0; i < 3000; i+=2) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        void* v = hashmap_remove(&h, key);
+        errors += (v == NULL) ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+
+    // test present what was left
+    errors = 0;
+    for (int i = 1; i < 3000; i+=2) {
+        char key[15] = {0};
+        char val[15] = {0};
+        sprintf(key, "%d", i);
+        sprintf(val, "%d-v", i);
+        void* v = hashmap_get(&h, key);
+        errors += (v != NULL && strcmp((char*)v, val) == 0) ? 0 : 1;
+        free(v); // cleanup
+    }
+    mu_assert_int_eq(0, errors);
+}
+
+MU_TEST(test_hashmap_remove_mallocd) {
+    for (int i = 0; i < 3000; ++i) {
+        char key[15] = {0};
+        char* val = (char*)calloc(15, sizeof(char));
+        sprintf(key, "%d", i);
+        sprintf(val, "%d-v", i);
+        hashmap_set_alt(&h, key, val);
+    }
+
+    // test getting back NULL since it will try to free it for us
+    int errors = 0;
+    for (int i = 0; i < 3000; i+=2) {
+        char key[15] = {0};
+        char val[15] = {0};
+        sprintf(key, "%d", i);
+        sprintf(val, "%d-v", i);
+        void* v = hashmap_remove(&h, key);
+        errors += (v == NULL) ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+
+    // test not present what was removed
+    errors = 0;
+    for (int i = 0; i < 3000; i+=2) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        void* v = hashmap_remove(&h, key);
+        errors += (v == NULL) ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+
+    // test present what was left
+    errors = 0;
+    for (int i = 1; i < 3000; i+=2) {
+        char key[15] = {0};
+        char val[15] = {0};
+        sprintf(key, "%d", i);
+        sprintf(val, "%d-v", i);
+        void* v = hashmap_get(&h, key);
+        errors += (v != NULL && strcmp((char*)v, val) == 0) ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+}
+
+MU_TEST(test_hashmap_remove_many) {
+    char keys[4000][15];
+    const char* batch[4000];
+    void* values[4000];
+    for (int i = 0; i < 3000; ++i) {
+        sprintf(keys[i], "%d", i);
+        hashmap_set_int(&h, keys[i], i);
+    }
+    hashmap_set(&h, "user", keys[0]);
+
+    // every third key, some missing keys, a duplicate, and a value not owned by the hashmap
+    int n = 0;
+    for (int i = 0; i < 3000; i += 3) {
+        batch[n++] = keys[i];
+    }
+    for (int i = 3000; i < 3100; ++i) {
+        sprintf(keys[i], "%d", i);
+        batch[n++] = keys[i];
+    }
+    batch[n++] = keys[0];
+    batch[n++] = "user";
+
+    mu_assert_int_eq(1001, hashmap_remove_many(&h, batch, n, values));
+    mu_assert_int_eq(2000, hashmap_number_keys(h));
+    mu_assert(values[n - 1] == keys[0], "Expected the user value back");
+    mu_assert_null(values[n - 2]);  // duplicate
+    mu_assert_null(values[0]);      // owned by the hashmap
+
+    int errors = 0;
+    for (int i = 0; i < 3000; ++i) {
+        int* v = (int*)hashmap_get(&h, keys[i]);
+        if (i % 3 == 0) {
+            errors += (v == NULL) ? 0 : 1;
+        } else {
+            errors += (v != NULL && *v == i) ? 0 : 1;
+        }
+    }
+    mu_assert_int_eq(0, errors);
+
+    // a small batch removes key by key
+    batch[0] = keys[1];
+    batch[1] = keys[2];
+    mu_assert_int_eq(2, hashmap_remove_many(&h, batch, 2, NULL));
+    mu_assert_null(hashmap_get(&h, keys[1]));
+    mu_assert_int_eq(1998, hashmap_number_keys(h));
+}
+
+static int is_even(const char *key, void *value, void *ctx) {
+    (void)key;
+    ++*(int*)ctx;
+    return *(int*)value % 2 == 0;
+}
+
+MU_TEST(test_hashmap_remove_if) {
+    for (int i = 0; i < 3000; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        hashmap_set_int(&h, key, i);
+    }
+
+    int calls = 0;
+    mu_assert_int_eq(1500, hashmap_remove_if(&h, &is_even, &calls));
+    mu_assert_int_eq(3000, calls);
+    mu_assert_int_eq(1500, hashmap_number_keys(h));
+
+    int errors = 0;
+    for (int i = 0; i < 3000; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        int* v = (int*)hashmap_get(&h, key);
+        if (i % 2 == 0) {
+            errors += (v == NULL) ? 0 : 1;
+        } else {
+            errors += (v != NULL && *v == i) ? 0 : 1;
+        }
+    }
+    mu_assert_int_eq(0, errors);
+}
+
+/*******************************************************************************
+*   Test Merge
+*******************************************************************************/
+static void* sum_ints(const char *key, void *dst_value, void *src_value, void *ctx) {
+    (void)key;
+    ++*(int*)ctx;
+    *(int*)dst_value += *(int*)src_value;
+    return dst_value;
+}
+
+static void* keep_src(const char *key, void *dst_value, void *src_value, void *ctx) {
+    (void)key;
+    (void)dst_value;
+    (void)ctx;
+    return src_value;
+}
+
+MU_TEST(test_hashmap_merge) {
+    HashMap src;
+    hashmap_init_alt(&src, 64, NULL);
+    for (int i = 0; i < 3000; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        hashmap_set_int(&h, key, i);
+    }
+    for (int i = 2000; i < 5000; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        hashmap_set_int(&src, key, i);
+    }
+
+    int conflicts = 0;
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_merge(&h, &src, &sum_ints, &conflicts));
+    mu_assert_int_eq(1000, conflicts);
+    mu_assert_int_eq(5000, hashmap_number_keys(h));
+    mu_assert_int_eq(0, hashmap_number_keys(src));
+    mu_assert(hashmap_get_fullness(&h) < 25.0, "Expected the map to be presized");
+
+    int errors = 0;
+    for (int i = 0; i < 5000; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        int* v = (int*)hashmap_get(&h, key);
+        int expected = (i >= 2000 && i < 3000) ? 2 * i : i;
+        errors += (v != NULL && *v == expected) ? 0 : 1;
+        errors += (hashmap_get(&src, key) == NULL) ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+
+    // the source map is still usable
+    hashmap_set_int(&src, "1", -1);
+    mu_assert_int_eq(1, hashmap_number_keys(src));
+    hashmap_destroy(&src);
+}
+
+/* keys starting with the same digit share a cluster */
+static uint64_t first_char_hash(const char *key) {
+    return (uint64_t)key[0];
+}
+
+MU_TEST(test_hashmap_merge_no_memory) {
+    // dst copies its keys into a pool whose allocator runs out part way
+    limited_allocations allocs = {0, 1000};
+    hashmap_allocator allocator = {&limited_malloc, &limited_calloc, &limited_realloc, &limited_free, &allocs};
+    HashMap pool, dst, src;
+    hashmap_init_with_allocator(&pool, 1024, NULL, &allocator);
+    hashmap_init_interned(&dst, 1024, NULL, &pool);
+    hashmap_init_alt(&src, 512, &first_char_hash);  // the keys left behind must still be found
+    for (int i = 0; i < 100; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        hashmap_set_int(&src, key, i);
+    }
+
+    allocs.budget = 2 * 40 + 1;  // a node and key for each of 40 keys, then half of the next
+    mu_assert_int_eq(HASHMAP_FAILURE, hashmap_merge(&dst, &src, NULL, NULL));
+    mu_assert_int_eq(40, dst.used_nodes);
+    mu_assert_int_eq(60, src.used_nodes);
+    int errors = 0;
+    for (int i = 0; i < 100; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        int *d = (int*)hashmap_get(&dst, key), *s = (int*)hashmap_get(&src, key);
+        errors += ((d == NULL) != (s == NULL) && *(d != NULL ? d : s) == i) ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+
+    // with memory again the rest moves over
+    allocs.budget = 1000;
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_merge(&dst, &src, NULL, NULL));
+    mu_assert_int_eq(100, dst.used_nodes);
+    mu_assert_int_eq(0, src.used_nodes);
+    hashmap_destroy(&src);
+    hashmap_destroy(&dst);
+    hashmap_destroy(&pool);
+    mu_assert_int_eq(0, allocs.live);
+}
+
+MU_TEST(test_hashmap_merge_rehash) {
+    HashMap src;
+    hashmap_init_seeded(&src, 1024, NULL, NULL);
+    hashmap_set_int(&h, "a", 1);
+    hashmap_set_int(&h, "b", 2);
+    hashmap_set_int(&src, "b", 20);
+    hashmap_set_int(&src, "c", 30);
+
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_merge(&h, &src, &keep_src, NULL));
+    mu_assert_int_eq(3, hashmap_number_keys(h));
+    mu_assert_int_eq(1, *(int*)hashmap_get(&h, "a"));
+    mu_assert_int_eq(20, *(int*)hashmap_get(&h, "b"));
+    mu_assert_int_eq(30, *(int*)hashmap_get(&h, "c"));
+    hashmap_destroy(&src);
+}
+
+/*******************************************************************************
+*   Test Clone
+*******************************************************************************/
+static void* copy_upper(const char *key, const void *value, void *ctx) {
+    (void)key;
+    ++*(int*)ctx;
+    char *v = (char*)calloc(strlen((const char*)value) + 1, sizeof(char));
+    for (int i = 0; ((const char*)value)[i] != '\0'; ++i) {
+        v[i] = ((const char*)value)[i] - 'a' + 'A';
+    }
+    return v;
+}
+
+MU_TEST(test_hashmap_clone) {
+    HashMap c;
+    char key[15] = {0};
+    for (int i = 0; i < 3000; ++i) {
+        sprintf(key, "%d", i);
+        hashmap_set_int(&h, key, i);
+    }
+    hashmap_set_string(&h, "str", "abc");
+    hashmap_set(&h, "user", (void*)"shared");
+    hashmap_set_ttl(&h, "ttl", (void*)"expires", UINT64_MAX - 1);
+    hashmap_multi_add(&h, "multi", (void*)"one");
+    hashmap_multi_add(&h, "multi", (void*)"two");
+    hashmap_enable_bloom(&h);
+
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_clone(&c, &h, NULL, NULL));
+    mu_assert_int_eq(h.used_nodes, c.used_nodes);
+    mu_assert_int_eq(h.number_nodes, c.number_nodes);
+    for (uint64_t i = 0; i < h.number_nodes; ++i) {  // the same layout, nothing was re-placed
+        mu_assert_int_eq(h.nodes[i] == NULL, c.nodes[i] == NULL);
+        if (h.nodes[i] != NULL) {
+            mu_assert_string_eq(h.nodes[i]->key, c.nodes[i]->key);
+            mu_assert_int_eq(h.nodes[i]->hash, c.nodes[i]->hash);
+            mu_assert(h.nodes[i] != c.nodes[i], "nodes are copied");
+        }
+    }
+    hashmap_memory mh, mc;
+    hashmap_memory_usage(&h, &mh);
+    hashmap_memory_usage(&c, &mc);
+    mu_assert_int_eq(mh.total, mc.total);
+
+    // owned values are copied, the user's are shared
+    mu_assert_string_eq("abc", (char*)hashmap_get(&c, "str"));
+    mu_assert(hashmap_get(&c, "str") != hashmap_get(&h, "str"), "owned values are copied");
+    mu_assert(hashmap_get(&c, "user") == hashmap_get(&h, "user"), "user values are shared");
+    mu_assert_string_eq("expires", (char*)hashmap_get(&c, "ttl"));
+    uint64_t count;
+    mu_assert_string_eq("two", (char*)hashmap_multi_get(&c, "multi", &count)[1]);
+    mu_assert_int_eq(2, count);
+
+    // the two maps are independent from here on
+    hashmap_increment(&h, "5", 10);
+    hashmap_remove(&h, "6");
+    mu_assert_int_eq(5, *(int*)hashmap_get(&c, "5"));
+    mu_assert_int_eq(6, *(int*)hashmap_get(&c, "6"));
+    hashmap_destroy(&c);
+
+    int copies = 0;
+    HashMap strings, s2;
+    hashmap_init(&strings);
+    hashmap_set_string(&strings, "a", "abc");
+    hashmap_set_string(&strings, "b", "xyz");
+    hashmap_set(&strings, "c", (void*)"mine");
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_clone(&s2, &strings, copy_upper, &copies));
+    mu_assert_int_eq(2, copies);
+    mu_assert_string_eq("ABC", (char*)hashmap_get(&s2, "a"));
+    mu_assert_string_eq("mine", (char*)hashmap_get(&s2, "c"));
+    hashmap_destroy(&strings);
+    hashmap_destroy(&s2);
+}
+
+MU_TEST(test_hashmap_clone_resizing) {
+    HashMap inc, c;
+    char key[15] = {0};
+    hashmap_init_incremental(&inc, 64, NULL);
+    for (int i = 0; i < 17; ++i) {  // the 17th insert starts a resize
+        sprintf(key, "%d", i);
+        hashmap_set_int(&inc, key, i);
+    }
+    mu_assert(inc.old_nodes != NULL, "resize in progress");
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_clone(&c, &inc, NULL, NULL));
+    mu_assert_int_eq(inc.migrated, c.migrated);
+    for (int i = 0; i < 1000; ++i) {
+        sprintf(key, "%d", i);
+        hashmap_set_int(&c, key, i);
+    }
+    for (int i = 0; i < 1000; ++i) {
+        sprintf(key, "%d", i);
+        mu_assert_int_eq(i, *(int*)hashmap_get(&c, key));
+    }
+    hashmap_destroy(&c);
+    hashmap_destroy(&inc);
+
+    HashMap cuckoo;
+    hashmap_init_cuckoo(&cuckoo, 64, NULL);
+    for (int i = 0; i < 500; ++i) {
+        sprintf(key, "%d", i);
+        hashmap_set_int(&cuckoo, key, i);
+    }
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_clone(&c, &cuckoo, NULL, NULL));
+    for (int i = 0; i < 500; ++i) {
+        sprintf(key, "%d", i);
+        mu_assert_int_eq(i, *(int*)hashmap_get(&c, key));
+    }
+    hashmap_destroy(&c);
+    hashmap_destroy(&cuckoo);
+}
+
+/*******************************************************************************
+*   Test Aggregation
+*******************************************************************************/
+static void* add_counts(const char *key, void *dst_value, void *src_value, void *ctx) {
+    (void)key;
+    (void)ctx;
+    *(int*)dst_value += *(int*)src_value;
+    return dst_value;
+}
+
+MU_TEST(test_hashmap_aggregator) {
+    HashMapAggregator a;
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_aggregator_init(&a, 4, 1024, NULL));
+    mu_assert_int_eq(4, a.nthreads);
+    mu_assert_null(hashmap_aggregator_local(&a, 4));
+    for (int t = 0; t < 4; ++t) {  // each thread's map starts its own cache line
+        mu_assert_int_eq(0, (uintptr_t)hashmap_aggregator_local(&a, t) % 64);
+    }
+
+    // each "thread" counts an overlapping range of words
+    for (int t = 0; t < 4; ++t) {
+        HashMap *local = hashmap_aggregator_local(&a, t);
+        for (int i = t * 1000; i < t * 1000 + 2000; ++i) {
+            char key[15] = {0};
+            sprintf(key, "%d", i);
+            hashmap_increment(local, key, 1);
+        }
+    }
+    hashmap_increment(&h, "0", 10);  // already in the destination
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_aggregator_reduce(&a, &h, &add_counts, NULL));
+    mu_assert_int_eq(5000, h.used_nodes);
+
+    int errors = 0;
+    for (int i = 0; i < 5000; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        int *v = (int*)hashmap_get(&h, key);
+        int expected = (i < 1000 || i >= 4000) ? 1 : 2;
+        errors += (v != NULL && *v == expected + (i == 0 ? 10 : 0)) ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+
+    // the thread maps are emptied for reuse
+    mu_assert_int_eq(0, hashmap_aggregator_local(&a, 2)->used_nodes);
+    hashmap_increment(hashmap_aggregator_local(&a, 1), "0", 1);
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_aggregator_reduce(&a, &h, &add_counts, NULL));
+    mu_assert_int_eq(12, *(int*)hashmap_get(&h, "0"));
+    hashmap_aggregator_destroy(&a);
+}
+
+MU_TEST(test_hashmap_aggregator_no_memory) {
+    // dst copies its keys into a pool whose allocator runs out part way
+    limited_allocations allocs = {0, 1000};
+    hashmap_allocator allocator = {&limited_malloc, &limited_calloc, &limited_realloc, &limited_free, &allocs};
+    HashMap pool, dst;
+    HashMapAggregator a;
+    hashmap_init_with_allocator(&pool, 4096, NULL, &allocator);
+    hashmap_init_interned(&dst, 1024, NULL, &pool);
+    hashmap_aggregator_init(&a, 4, 1024, NULL);
+    for (int t = 0; t < 4; ++t) {
+        HashMap *local = hashmap_aggregator_local(&a, t);
+        for (int i = t * 100; i < t * 100 + 200; ++i) {
+            char key[15] = {0};
+            sprintf(key, "%d", i);
+            hashmap_increment(local, key, 1);
+        }
+    }
+
+    allocs.budget = 2 * 150;  // a node and key for each of 150 of the 500 keys
+    mu_assert_int_eq(HASHMAP_FAILURE, hashmap_aggregator_reduce(&a, &dst, &add_counts, NULL));
+    mu_assert_int_eq(150, dst.used_nodes);
+    uint64_t left = 0;
+    for (int t = 0; t < 4; ++t) {
+        left += hashmap_aggregator_local(&a, t)->used_nodes;
+    }
+    mu_assert_int_eq(350, left);  // each key not in dst is in a single thread map
+
+    // every count is kept, in dst or the thread maps
+    int errors = 0;
+    for (int i = 0; i < 500; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        int count = 0, *v = (int*)hashmap_get(&dst, key);
+        count += (v != NULL) ? *v : 0;
+        for (int t = 0; t < 4; ++t) {
+            v = (int*)hashmap_get(hashmap_aggregator_local(&a, t), key);
+            count += (v != NULL) ? *v : 0;
+        }
+        errors += (count == ((i < 100 || i >= 400) ? 1 : 2)) ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+
+    // with memory again the rest is reduced
+    allocs.budget = 2000;
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_aggregator_reduce(&a, &dst, &add_counts, NULL));
+    mu_assert_int_eq(500, dst.used_nodes);
+    mu_assert_int_eq(2, *(int*)hashmap_get(&dst, "250"));
+    hashmap_aggregator_destroy(&a);
+    hashmap_destroy(&dst);
+    hashmap_destroy(&pool);
+    mu_assert_int_eq(0, allocs.live);
+}
+
+/*******************************************************************************
+*   Test Typed Maps
+*******************************************************************************/
+static void sum_typed(uint64_t key, int *value, void *ctx) {
+    *(uint64_t*)ctx += key + *value;
+}
+
+MU_TEST(test_hashmap_typed) {
+    intmap m;
+    int inserted, removed;
+    mu_assert_int_eq(HASHMAP_SUCCESS, intmap_init(&m, 16));
+    for (uint64_t i = 0; i < 10000; ++i) {  // grows several times
+        mu_assert_int_eq(HASHMAP_SUCCESS, intmap_set(&m, i, (int)i));
+    }
+    mu_assert_int_eq(10000, m.used_nodes);
+    mu_assert_int_eq(32768, m.number_nodes);
+    mu_assert_int_eq(1234, *intmap_get(&m, 1234));
+    mu_assert_null(intmap_get(&m, 10000));
+
+    *intmap_get_or_insert(&m, 1234, &inserted) += 1;
+    mu_assert_int_eq(0, inserted);
+    mu_assert_int_eq(1235, *intmap_get(&m, 1234));
+    mu_assert_int_eq(0, *intmap_get_or_insert(&m, 20000, &inserted));  // new values are zeroed
+    mu_assert_int_eq(1, inserted);
+
+    for (uint64_t i = 0; i < 10000; i += 2) {
+        mu_assert_int_eq(HASHMAP_SUCCESS, intmap_remove(&m, i, &removed));
+        mu_assert_int_eq((i == 1234) ? 1235 : (int)i, removed);
+    }
+    mu_assert_int_eq(HASHMAP_FAILURE, intmap_remove(&m, 0, NULL));
+    for (uint64_t i = 0; i < 10000; ++i) {  // the clusters were re-laid out
+        if (i % 2 == 0) {
+            mu_assert_null(intmap_get(&m, i));
+        } else {
+            mu_assert_int_eq((int)i, *intmap_get(&m, i));
+        }
+    }
+    uint64_t sum = 0;
+    intmap_for_each(&m, sum_typed, &sum);
+    mu_assert_int_eq(2 * 25000000 + 20000, sum);
+    intmap_clear(&m);
+    mu_assert_int_eq(0, m.used_nodes);
+    mu_assert_null(intmap_get(&m, 1));
+    intmap_destroy(&m);
+
+    strmap s;
+    char key[] = {'t', 'w', 'o', '\0'};
+    strmap_init(&s, 0);
+    strmap_set(&s, "one", 1.0);
+    strmap_set(&s, "two", 2.0);
+    mu_assert_double_eq(2.0, *strmap_get(&s, key));  // compared by content
+    mu_assert_int_eq(HASHMAP_SUCCESS, strmap_reserve(&s, 100));
+    mu_assert_int_eq(256, s.number_nodes);
+    mu_assert_double_eq(1.0, *strmap_get(&s, "one"));
+    strmap_destroy(&s);
+}
+
+MU_TEST(test_hashmap_typed_edges) {
+    intmap m;
+    uint64_t max_probe;
+    float avg_probe;
+    mu_assert_int_eq(HASHMAP_SUCCESS, intmap_init(&m, 1));
+    mu_assert_int_eq(2, m.number_nodes);
+    intmap_set(&m, 1, 1);
+    mu_assert_null(intmap_get(&m, 2));  // the probe ends on an open slot
+    intmap_set(&m, 2, 2);
+    mu_assert_null(intmap_get(&m, 3));
+    mu_assert_int_eq(2, *intmap_get(&m, 2));
+
+    for (uint64_t i = 0; i < 1000; ++i) {
+        intmap_set(&m, i, (int)i);
+    }
+    intmap_stats(&m, &max_probe, &avg_probe);
+    mu_assert(max_probe >= 1, "Expected every key to take a probe");
+    mu_assert(avg_probe >= 1.0 && avg_probe <= max_probe, "Expected the average within the longest probe");
+
+    // a destroyed map is empty and can be used again
+    intmap_destroy(&m);
+    mu_assert_null(intmap_get(&m, 1));
+    mu_assert_int_eq(HASHMAP_FAILURE, intmap_remove(&m, 1, NULL));
+    intmap_clear(&m);
+    intmap_stats(&m, &max_probe, &avg_probe);
+    mu_assert_int_eq(0, max_probe);
+    mu_assert_double_eq(0.0, intmap_get_fullness(&m));
+    mu_assert_int_eq(HASHMAP_SUCCESS, intmap_set(&m, 7, 7));
+    mu_assert_int_eq(7, *intmap_get(&m, 7));
+    intmap_destroy(&m);
+    mu_assert_int_eq(HASHMAP_SUCCESS, intmap_reserve(&m, 10));
+    mu_assert_int_eq(32, m.number_nodes);
+    intmap_destroy(&m);
+}
+
+/*******************************************************************************
+*   Test Keys
+*******************************************************************************/
+MU_TEST(test_hashmap_keys) {
+    // add some values
+    for (int i = 0; i < 3000; ++i) {
+        char key[15] = {0};
+        char* val = (char*)calloc(15, sizeof(char));
+        sprintf(key, "%d", i);
+        sprintf(val, "%d-v", i);
+        hashmap_set(&h, key, val);
+    }
+
+    char** keys = hashmap_keys(&h);
+    // make some tests
+    int errors = 0;
+    unsigned s = hashmap_number_keys(h);
+    for (unsigned int i = 0; i < s; ++i) {
+        void* val = hashmap_get(&h, keys[i]);
+        int key_i = atoi(keys[i]);
+        char val_c[15] = {0};
+        sprintf(val_c, "%d-v", key_i);
+        errors += (val != NULL && strcmp((char*)val, val_c) == 0) ? 0 : 1;
+        free(val);
+    }
+    mu_assert_int_eq(0, errors);
+
+    // free the data
+    for (unsigned int i = 0; i < hashmap_number_keys(h); ++i) {
+        free(keys[i]);
+    }
+    free(keys);
+
+}
+
+MU_TEST(test_hashmap_keys_sorted) {
+    // keys with shared prefixes so the radix sort has to go deep
+    for (int i = 0; i < 3000; ++i) {
+        char key[25] = {0};
+        sprintf(key, "%s%d", (i % 3 == 0) ? "prefix/shared/" : "", i * 7);
+        hashmap_set_int(&h, key, i);
+    }
+
+    void** values = NULL;
+    const char** keys = hashmap_keys_sorted(&h, HASHMAP_SORT_KEYS, &values);
+    mu_assert_not_null(keys);
+    int errors = 0;
+    for (unsigned int i = 0; i < hashmap_number_keys(h); ++i) {
+        if (i > 0) {
+            errors += (strcmp(keys[i - 1], keys[i]) < 0) ? 0 : 1;
+        }
+        errors += (hashmap_get(&h, keys[i]) == values[i]) ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+    free(keys);
+    free(values);
+
+    keys = hashmap_keys_sorted(&h, HASHMAP_SORT_HASH, NULL);
+    mu_assert_not_null(keys);
+    for (unsigned int i = 1; i < hashmap_number_keys(h); ++i) {
+        errors += (default_fnv1a(keys[i - 1]) <= default_fnv1a(keys[i])) ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+    free(keys);
+}
+
+/*******************************************************************************
+*   Test Iteration
+*******************************************************************************/
+static void sum_values(const char *key, void *value, void *ctx) {
+    (void)key;
+    __atomic_fetch_add((long*)ctx, *(int*)value, __ATOMIC_RELAXED);
+}
+
+MU_TEST(test_hashmap_for_each) {
+    for (int i = 0; i < 3000; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        hashmap_set_int(&h, key, i);
+    }
+
+    long sum = 0;
+    hashmap_for_each(&h, &sum_values, &sum);
+    mu_assert_int_eq(4498500, sum);
+}
+
+MU_TEST(test_hashmap_parallel_for_each) {
+    for (int i = 0; i < 3000; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        hashmap_set_int(&h, key, i);
+    }
+
+    for (int t = 1; t < 8; ++t) {
+        long sum = 0;
+        mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_parallel_for_each(&h, &sum_values, &sum, t));
+        mu_assert_int_eq(4498500, sum);
+    }
+
+    // empty and tiny maps
+    HashMap q;
+    hashmap_init_alt(&q, 3, NULL);
+    long sum = 0;
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_parallel_for_each(&q, &sum_values, &sum, 4));
+    mu_assert_int_eq(0, sum);
+    hashmap_destroy(&q);
+}
+
+/*******************************************************************************
+*   Test Streaming
+*******************************************************************************/
+static size_t encode_int(const char *key, const void *value, void *buf, size_t buf_len, void *ctx) {
+    (void)key;
+    (void)ctx;
+    if (buf_len >= sizeof(int)) {
+        memcpy(buf, value, sizeof(int));
+    }
+    return sizeof(int);
+}
+
+static void* decode_int(const char *key, const void *buf, size_t len, void *ctx) {
+    (void)key;
+    (void)ctx;
+    int* v = (int*)malloc(sizeof(int));
+    memcpy(v, buf, (len < sizeof(int)) ? len : sizeof(int));
+    return v;
+}
+
+MU_TEST(test_hashmap_stream) {
+    for (int i = 0; i < 30000; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        hashmap_set_int(&h, key, i);
+    }
+
+    FILE* fp = tmpfile();
+    int fd = fileno(fp);
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_write_stream(&h, fd, &encode_int, NULL));
+    lseek(fd, 0, SEEK_SET);
+
+    HashMap q;
+    hashmap_init(&q);
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_read_stream(&q, fd, &decode_int, NULL));
+    fclose(fp);
+    mu_assert_int_eq(30000, hashmap_number_keys(q));
+    mu_assert(hashmap_get_fullness(&q) < 25.0, "Expected the map to be presized");
+
+    int errors = 0;
+    for (int i = 0; i < 30000; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        int* v = (int*)hashmap_get(&q, key);
+        errors += (v != NULL && *v == i) ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+    hashmap_destroy(&q);
+}
+
+MU_TEST(test_hashmap_stream_strings) {
+    char big[100000];
+    memset(big, 'x', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    hashmap_set_string(&h, "google", "search engine, android, web ads");
+    hashmap_set_string(&h, "empty", "");
+    hashmap_set_string(&h, "big", big);
+    hashmap_set(&h, "none", NULL);
+
+    FILE* fp = tmpfile();
+    int fd = fileno(fp);
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_write_stream(&h, fd, NULL, NULL));
+    lseek(fd, 0, SEEK_SET);
+
+    HashMap q;
+    hashmap_init(&q);
+    mu_assert_int_eq(HASHMAP_SUCCESS, hashmap_read_stream(&q, fd, NULL, NULL));
+    mu_assert_int_eq(4, hashmap_number_keys(q));
+    mu_assert_string_eq("search engine, android, web ads", (char*)hashmap_get(&q, "google"));
+    mu_assert_string_eq("", (char*)hashmap_get(&q, "empty"));
+    mu_assert_null(hashmap_get(&q, "none"));  // not an empty string
+    mu_assert(strcmp(big, (char*)hashmap_get(&q, "big")) == 0, "Expected the large value to round trip");
+
+    // not a hashmap stream
+    lseek(fd, 0, SEEK_SET);
+    mu_assert_int_eq(1, (int)write(fd, "X", 1));
+    lseek(fd, 0, SEEK_SET);
+    mu_assert_int_eq(HASHMAP_FAILURE, hashmap_read_stream(&q, fd, NULL, NULL));
+    fclose(fp);
+    hashmap_destroy(&q);
+}
+
+/* a stream header claiming `count` keys followed by `len` bytes of records */
+static FILE* malformed_stream(uint64_t count, const unsigned char *records, size_t len) {
+    unsigned char header[16] = {'H', 'M', 'A', 'P', 2, 0, 0, 0};
+    for (int i = 0; i < 8; ++i) {
+        header[8 + i] = (unsigned char)(count >> (8 * i));
+    }
+    FILE* fp = tmpfile();
+    fwrite(header, 1, sizeof(header), fp);
+    fwrite(records, 1, len, fp);
+    fflush(fp);
+    lseek(fileno(fp), 0, SEEK_SET);
+    return fp;
+}
+
+MU_TEST(test_hashmap_stream_malformed) {
+    HashMap q;
+    hashmap_init(&q);
+    // a one key stream claiming far more keys only presizes for some of them
+    const unsigned char one[] = {1, 0, 0, 0, 'a', 1, 0, 0, 0, 'b'};
+    FILE* fp = malformed_stream(UINT64_MAX, one, sizeof(one));
+    mu_assert_int_eq(HASHMAP_FAILURE, hashmap_read_stream(&q, fileno(fp), NULL, NULL));
+    fclose(fp);
+    mu_assert_string_eq("b", (char*)hashmap_get(&q, "a"));
+    mu_assert(q.number_nodes <= 8388608, "Expected the presize to be capped");
+
+    // lengths past the limit, and lengths longer than the stream
+    const unsigned char huge_key[] = {0xf0, 0xff, 0xff, 0xff, 'a'};
+    fp = malformed_stream(1, huge_key, sizeof(huge_key));
+    mu_assert_int_eq(HASHMAP_FAILURE, hashmap_read_stream(&q, fileno(fp), NULL, NULL));
+    fclose(fp);
+    const unsigned char long_value[] = {1, 0, 0, 0, 'c', 0xff, 0xff, 0xff, 0x7f, 'x', 'y'};
+    fp = malformed_stream(1, long_value, sizeof(long_value));
+    mu_assert_int_eq(HASHMAP_FAILURE, hashmap_read_stream(&q, fileno(fp), NULL, NULL));
+    fclose(fp);
+    mu_assert_null(hashmap_get(&q, "c"));
+
+    // keys cannot hold a NUL
+    const unsigned char nul_key[] = {3, 0, 0, 0, 'd', '\0', 'e', 0, 0, 0, 0};
+    fp = malformed_stream(1, nul_key, sizeof(nul_key));
+    mu_assert_int_eq(HASHMAP_FAILURE, hashmap_read_stream(&q, fileno(fp), NULL, NULL));
+    fclose(fp);
+    mu_assert_int_eq(1, hashmap_number_keys(q));
+    hashmap_destroy(&q);
+}
+
+/*******************************************************************************
+*   Test Statistics
+*******************************************************************************/
+/* save the printout of hashmap_stats to a buffer of at least 1024 bytes */
+static void capture_stats(const HashMap* map, char* buffer) {
+    int stdout_save;
+    fflush(stdout); //clean everything first
+    stdout_save = dup(STDOUT_FILENO); //save the stdout state
+    freopen("output_file", "a", stdout); //redirect stdout to null pointer
+    setvbuf(stdout, buffer, _IOFBF, 1024); //set buffer to stdout
+
+    hashmap_stats(map);
+
+    /* reset stdout */
+    freopen("output_file", "a", stdout); //redirect stdout to null again
+    dup2(stdout_save, STDOUT_FILENO); //restore the previous state of stdout
+    setvbuf(stdout, NULL, _IONBF, 0); //disable buffer to print to screen instantly
+
+    // Not sure this is necessary, but it cleans it up
+    remove("output_file");
+}
+
+MU_TEST(test_hashmap_stat) {
+    for (int i = 0; i < 55000; ++i) {
+        char key[15] = {0};
+        char val[15] = {0};
+        sprintf(key, "%d", i);
+        sprintf(val, "%d-v", i);
+        hashmap_set(&h, key, val);
+    }
+
+    char buffer[2046] = {0};
+    capture_stats(&h, buffer);
+
+    mu_assert_not_null(buffer);
+    mu_assert_string_eq("HashMap:\n\
+    Number Nodes: 262144\n\
+    Used Nodes: 55000\n\
+    Fullness: 20.980835%\n\
+    Average O(n): 1.041344\n\
+    Average Used O(n): 1.197055\n\
+    Max O(n): 9\n\
+    Max Consecutive Buckets Used: 11\n\
+    Number Hash Collisions: 0\n\
+    Number Index Collisions: 7656\n\
+    Size on disk (bytes): 4559568\n", buffer);
+}
+
+MU_TEST(test_hashmap_stat_resizing) {
+    HashMap inc;
+    hashmap_init_incremental(&inc, 1024, NULL);
+    for (int i = 0; i < 270; ++i) {  // the 257th key starts a resize
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        hashmap_set(&inc, key, NULL);
+    }
+    mu_assert_not_null(inc.old_nodes);  // most keys are still in the old array
+
+    char during[2046] = {0}, after[2046] = {0};
+    float avg_used;
+    unsigned int idx_during, idx_after;
+    capture_stats(&inc, during);
+    hashmap_resize_step(&inc, UINT64_MAX);
+    capture_stats(&inc, after);
+    mu_assert_int_eq(1, sscanf(strstr(during, "Average Used O(n):"), "Average Used O(n): %f", &avg_used));
+    mu_assert(avg_used >= 1.0, "Expected every key to count at least one probe");
+    mu_assert_int_eq(1, sscanf(strstr(during, "Number Index Collisions:"), "Number Index Collisions: %u", &idx_during));
+    mu_assert_int_eq(1, sscanf(strstr(after, "Number Index Collisions:"), "Number Index Collisions: %u", &idx_after));
+    mu_assert_int_eq(idx_after, idx_during);
+    hashmap_destroy(&inc);
+}
+
+MU_TEST(test_hashmap_fullness) {
+    /* on empty */
+    mu_assert_double_eq(0.0, hashmap_get_fullness(&h));
+
+    for (int i = 0; i < 3000; ++i) {
+        char key[15] = {0};
+        char val[15] = {0};
+        sprintf(key, "%d", i);
+        sprintf(val, "%d-v", i);
+        hashmap_set(&h, key, val);
+    }
+
+    mu_assert_double_eq(18.310546875, hashmap_get_fullness(&h));
+}
+
+MU_TEST(test_hashmap_memory_usage) {
+    hashmap_memory m, empty;
+    uint64_t total = hashmap_memory_usage(&h, &empty);
+    mu_assert_int_eq(1024 * (sizeof(hashmap_node*) + 1), empty.buckets);
+    mu_assert_int_eq(0, empty.nodes);
+    mu_assert_int_eq(0, empty.keys);
+    mu_assert_int_eq(0, empty.values);
+    mu_assert_int_eq(empty.total, total);
+
+    hashmap_set_int(&h, "a", 1);
+    hashmap_set_string(&h, "bb", "hello");
+    hashmap_set(&h, "ccc", (void*)"not owned");
+    hashmap_increment(&h, "dddd", 1);
+    hashmap_multi_add(&h, "eeeee", (void*)"x");
+    hashmap_memory_usage(&h, &m);
+    mu_assert_int_eq(5 * (sizeof(hashmap_node) + sizeof(uint64_t)), m.nodes);  // room for an expiry
+    mu_assert_int_eq(2 + 3 + 4 + 5 + 6, m.keys);
+    mu_assert_int_eq(sizeof(int) + 6 + sizeof(int) + 2 * sizeof(uint64_t) + 4 * sizeof(void*), m.values);
+    mu_assert_int_eq(m.buckets + m.nodes + m.keys + m.values + m.overhead, m.total);
+
+    // replacing values keeps the counts exact
+    hashmap_set_string(&h, "bb", "hello world");
+    hashmap_set_int(&h, "a", 2);
+    hashmap_set(&h, "ccc", (void*)"still not owned");
+    hashmap_memory_usage(&h, &m);
+    mu_assert_int_eq(sizeof(int) + 12 + sizeof(int) + 2 * sizeof(uint64_t) + 4 * sizeof(void*), m.values);
+    uint64_t nodes = m.nodes;
+    hashmap_set_ttl(&h, "a", NULL, 100);  // the node already has room for the expiry
+    hashmap_memory_usage(&h, &m);
+    mu_assert_int_eq(nodes, m.nodes);
+
+    for (int i = 0; i < 3000; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        hashmap_set_int(&h, key, i);
+    }
+    HashMap other;
+    hashmap_init(&other);
+    hashmap_set_string(&other, "bb", "moved");
+    hashmap_set_string(&other, "merged", "over");
+    hashmap_merge(&h, &other, NULL, NULL);  // the conflict keeps h's value
+    hashmap_memory_usage(&other, &m);
+    mu_assert_int_eq(0, m.nodes + m.keys + m.values);
+    hashmap_destroy(&other);
+
+    // removing everything leaves only the (grown) bucket arrays
+    const char* keys[] = {"a", "bb", "ccc", "dddd", "eeeee", "merged"};
+    hashmap_remove_many(&h, keys, 6, NULL);
+    for (int i = 0; i < 3000; ++i) {
+        char key[15] = {0};
+        sprintf(key, "%d", i);
+        hashmap_remove(&h, key);
+    }
+    hashmap_memory_usage(&h, &m);
+    mu_assert_int_eq(0, h.used_nodes);
+    mu_assert_int_eq(0, m.nodes);
+    mu_assert_int_eq(0, m.keys);
+    mu_assert_int_eq(0, m.values);
+    mu_assert_int_eq(h.number_nodes * (sizeof(hashmap_node*) + 1), m.buckets);
+}
+
+/*******************************************************************************
+*   Testsuite
+*******************************************************************************/
+MU_TEST_SUITE(test_suite) {
+    MU_SUITE_CONFIGURE(&test_setup, &test_teardown);
+
+    /* setup */
+    MU_RUN_TEST(test_default_setup);
+    MU_RUN_TEST(test_non_default_setup);
+    MU_RUN_TEST(test_seeded_setup);
+    MU_RUN_TEST(test_flags_setup);
+    MU_RUN_TEST(test_cuckoo_setup);
+
+    /* utility setters */
+    MU_RUN_TEST(test_hashmap_set_int);
+    MU_RUN_TEST(test_hashmap_set_long);
+    MU_RUN_TEST(test_hashmap_set_float);
+    MU_RUN_TEST(test_hashmap_set_double);
+    MU_RUN_TEST(test_hashmap_set_string);
+
+    /* setters */
+    MU_RUN_TEST(test_hashmap_set);
+    MU_RUN_TEST(test_hashmap_set_alt);
+    MU_RUN_TEST(test_hashmap_set_many);
+
+    /* getters */
+    MU_RUN_TEST(test_hashmap_get);
+    MU_RUN_TEST(test_hashmap_get_changed);
+    MU_RUN_TEST(test_hashmap_get_not_found);
+
+    /* seeded hashing */
+    MU_RUN_TEST(test_hashmap_siphash);
+    MU_RUN_TEST(test_hashmap_seeded);
+    MU_RUN_TEST(test_hashmap_seeded_probe_guard);
+
+    /* interned keys */
+    MU_RUN_TEST(test_hashmap_interned);
+    MU_RUN_TEST(test_hashmap_interned_resizing);
+    MU_RUN_TEST(test_hashmap_interned_merge);
+
+    /* allocation flags */
+    MU_RUN_TEST(test_hashmap_huge_pages);
+
+    /* cache mode */
+    MU_RUN_TEST(test_hashmap_cache);
+
+    /* expiry */
+    MU_RUN_TEST(test_hashmap_set_ttl);
+    MU_RUN_TEST(test_hashmap_set_ttl_slot);
+    MU_RUN_TEST(test_hashmap_expire_step);
+
+    /* frozen maps */
+    MU_RUN_TEST(test_hashmap_freeze);
+
+    /* compact maps */
+    MU_RUN_TEST(test_hashmap_compact);
+
+    /* fingerprint tags */
+    MU_RUN_TEST(test_hashmap_tags);
+
+    /* bloom filter */
+    MU_RUN_TEST(test_hashmap_bloom);
+    MU_RUN_TEST(test_hashmap_bloom_incremental);
+    MU_RUN_TEST(test_hashmap_bloom_cuckoo);
+
+    /* incremental resize */
+    MU_RUN_TEST(test_hashmap_incremental);
+
+    /* cuckoo engine */
+    MU_RUN_TEST(test_hashmap_cuckoo);
+
+    /* allocator */
+    MU_RUN_TEST(test_hashmap_allocator);
+
+    /* get or insert */
+    MU_RUN_TEST(test_hashmap_get_or_insert);
+    MU_RUN_TEST(test_hashmap_increment);
+    MU_RUN_TEST(test_hashmap_increment_no_memory);
+
+    /* multimap */
+    MU_RUN_TEST(test_hashmap_multi);
+
+    /* remove */
+    MU_RUN_TEST(test_hashmap_remove);
+    MU_RUN_TEST(test_hashmap_remove_mallocd);
+    MU_RUN_TEST(test_hashmap_remove_many);
+    MU_RUN_TEST(test_hashmap_remove_if);
+
+    /* merge */
+    MU_RUN_TEST(test_hashmap_merge);
+    MU_RUN_TEST(test_hashmap_merge_no_memory);
+    MU_RUN_TEST(test_hashmap_merge_rehash);
+
+    /* clone */
+    MU_RUN_TEST(test_hashmap_clone);
+    MU_RUN_TEST(test_hashmap_clone_resizing);
+
+    /* aggregation */
+    MU_RUN_TEST(test_hashmap_aggregator);
+    MU_RUN_TEST(test_hashmap_aggregator_no_memory);
+
+    /* typed maps */
+    MU_RUN_TEST(test_hashmap_typed);
+    MU_RUN_TEST(test_hashmap_typed_edges);
+
+    /* keys */
+    MU_RUN_TEST(test_hashmap_keys);
+    MU_RUN_TEST(test_hashmap_keys_sorted);
+
+    /* iteration */
+    MU_RUN_TEST(test_hashmap_for_each);
+    MU_RUN_TEST(test_hashmap_parallel_for_each);
+
+    /* streaming */
+    MU_RUN_TEST(test_hashmap_stream);
+    MU_RUN_TEST(test_hashmap_stream_strings);
+    MU_RUN_TEST(test_hashmap_stream_malformed);
 
     /* statistics */
     MU_RUN_TEST(test_hashmap_stat);
+    MU_RUN_TEST(test_hashmap_stat_resizing);
     MU_RUN_TEST(test_hashmap_fullness);
+    MU_RUN_TEST(test_hashmap_memory_usage);
 }
 
 